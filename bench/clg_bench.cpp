@@ -0,0 +1,641 @@
+//
+// Micro benchmarks of every binding path of cpp_lua_glue.
+//
+// Usage: clg_bench [filter] [--iterations N]
+//
+// Each benchmark reports wall time per operation, C++ heap allocations per operation (global operator new) and Lua
+// allocations per operation (lua_Alloc calls which allocate a new block).
+//
+
+#include "clg.hpp"
+#include "vm_pool.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace {
+    std::atomic<std::size_t> gCppAllocations = 0;
+    std::atomic<std::size_t> gLuaAllocations = 0;
+}
+
+void* operator new(std::size_t size) {
+    gCppAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+    struct lua_alloc_counter {
+        lua_Alloc original;
+        void* originalUd;
+
+        static void* alloc(void* ud, void* ptr, size_t osize, size_t nsize) {
+            auto self = static_cast<lua_alloc_counter*>(ud);
+            if (ptr == nullptr && nsize != 0) {
+                gLuaAllocations.fetch_add(1, std::memory_order_relaxed);
+            }
+            return self->original(self->originalUd, ptr, osize, nsize);
+        }
+
+        void install(lua_State* L) {
+            original = lua_getallocf(L, &originalUd);
+            lua_setallocf(L, alloc, this);
+        }
+    };
+
+    struct options {
+        std::string filter;
+        std::size_t iterations = 200000;
+    };
+
+    class bench_runner {
+    public:
+        explicit bench_runner(options o): mOptions(std::move(o)) {
+            std::printf("%-44s %12s %12s %12s\n", "benchmark", "ns/op", "allocs/op", "lua allocs/op");
+        }
+
+        /**
+         * @brief Runs body(iterations) once to warm up and once measured.
+         */
+        void run(const char* name, const std::function<void(std::size_t)>& body) {
+            if (!mOptions.filter.empty() && std::strstr(name, mOptions.filter.c_str()) == nullptr) {
+                return;
+            }
+            const auto n = mOptions.iterations;
+            body(n / 10 + 1);
+
+            const auto cppBefore = gCppAllocations.load();
+            const auto luaBefore = gLuaAllocations.load();
+            const auto begin = std::chrono::steady_clock::now();
+            body(n);
+            const auto end = std::chrono::steady_clock::now();
+            const auto cppAllocations = gCppAllocations - cppBefore;
+            const auto luaAllocations = gLuaAllocations - luaBefore;
+
+            const auto ns = std::chrono::duration<double, std::nano>(end - begin).count();
+            std::printf("%-44s %12.1f %12.2f %12.2f\n",
+                        name,
+                        ns / double(n),
+                        double(cppAllocations) / double(n),
+                        double(luaAllocations) / double(n));
+        }
+
+    private:
+        options mOptions;
+    };
+
+
+    int add(int a, int b) {
+        return a + b;
+    }
+
+    int add_noexcept(int a, int b) noexcept {
+        return a + b;
+    }
+
+    std::size_t string_length(const std::string& s) {
+        return s.size();
+    }
+
+    std::size_t view_length(std::string_view s) {
+        return s.size();
+    }
+
+    std::tuple<std::string, std::string> split_pair() {
+        return { std::string(32, 'k'), std::string(32, 'v') };
+    }
+
+    struct Counter {
+        int value = 0;
+
+        int get() const {
+            return value;
+        }
+
+        int get_noexcept() const noexcept {
+            return value;
+        }
+
+        void set(int v) {
+            value = v;
+        }
+
+        static int twice(int v) {
+            return v * 2;
+        }
+    };
+
+    struct Entity: clg::lua_self {
+        int hp = 100;
+
+        int health() const {
+            return hp;
+        }
+    };
+
+    struct CompactEntity: clg::compact_lua_self {
+        int hp = 100;
+
+        int health() const {
+            return hp;
+        }
+
+        void set_health(int v) {
+            hp = v;
+        }
+    };
+
+    struct Shape: clg::allow_lua_inheritance {
+        int id = 1;
+
+        int get_id() const {
+            return id;
+        }
+    };
+
+    struct Circle: Shape {};
+
+    struct Container {
+        std::vector<int> items = std::vector<int>(16, 1);
+
+        int at(int index) {
+            return items[std::size_t(index) % items.size()];
+        }
+
+        int size() const {
+            return int(items.size());
+        }
+    };
+
+    /**
+     * @brief Compiles a lua function once so the measured loop does not include parsing.
+     */
+    clg::function compile(clg::vm& vm, const char* source) {
+        return vm.do_string<clg::function>(source);
+    }
+
+    /**
+     * @brief Threads owning a clg::vm each. run(n) executes the same lua loop of n iterations on every thread at once.
+     */
+    class vm_per_thread {
+    public:
+        vm_per_thread(std::size_t threadCount, const char* source) {
+            for (std::size_t i = 0; i < threadCount; ++i) {
+                mThreads.emplace_back([this, source] { work(source); });
+            }
+        }
+
+        ~vm_per_thread() {
+            {
+                std::unique_lock lock(mSync);
+                mStop = true;
+            }
+            mCv.notify_all();
+            for (auto& t : mThreads) {
+                t.join();
+            }
+        }
+
+        void run(std::size_t n) {
+            std::unique_lock lock(mSync);
+            mIterations = n;
+            mPending = mThreads.size();
+            ++mGeneration;
+            mCv.notify_all();
+            mCv.wait(lock, [&] { return mPending == 0; });
+        }
+
+    private:
+        std::vector<std::thread> mThreads;
+        std::mutex mSync;
+        std::condition_variable mCv;
+        std::size_t mIterations = 0;
+        std::size_t mPending = 0;
+        std::size_t mGeneration = 0;
+        bool mStop = false;
+
+        void work(const char* source) {
+            clg::vm vm;
+            vm.register_function<add>("add");
+            auto f = compile(vm, source);
+            std::size_t generation = 0;
+            for (;;) {
+                std::size_t n;
+                {
+                    std::unique_lock lock(mSync);
+                    mCv.wait(lock, [&] { return mStop || mGeneration != generation; });
+                    if (mStop) {
+                        return;
+                    }
+                    generation = mGeneration;
+                    n = mIterations;
+                }
+                f.call<void>(n);
+                {
+                    std::unique_lock lock(mSync);
+                    --mPending;
+                }
+                mCv.notify_all();
+            }
+        }
+    };
+}
+
+
+int main(int argc, char** argv) {
+    options o;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            o.iterations = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            o.filter = argv[i];
+        }
+    }
+
+    clg::vm vm;
+    lua_alloc_counter counter;
+    counter.install(vm);
+
+    vm.register_function<add>("add");
+    vm.register_function<add_noexcept>("add_noexcept");
+    vm.register_function<add, clg::unchecked>("add_unchecked");
+    vm.register_function<string_length>("string_length");
+    vm.register_function<view_length>("view_length");
+    vm.register_function<split_pair>("split_pair");
+    vm.register_function("add_lambda", [](int a, int b) {
+        return a + b;
+    });
+    vm.register_function_overloaded("overloaded",
+                                    [](int a) { return a; },
+                                    [](int a, int b) { return a + b; },
+                                    [](const std::string& s) { return int(s.size()); });
+    vm.register_class<Counter>()
+        .constructor<>()
+        .method<&Counter::get>("get")
+        .method<&Counter::get_noexcept>("get_noexcept")
+        .method<&Counter::set>("set")
+        .method<&Counter::set, clg::unchecked>("set_unchecked")
+        .staticFunction<&Counter::twice>("twice");
+    vm.register_class<Entity>()
+        .method<&Entity::health>("health");
+    vm.register_class<CompactEntity>()
+        .method<&CompactEntity::health>("health")
+        .method<&CompactEntity::set_health>("set_health")
+        .property<&CompactEntity::hp>("hp");
+    vm.register_class<Shape>()
+        .method<&Shape::get_id>("get_id");
+    vm.register_class<Circle>()
+        .bases<Shape>();
+    vm.register_class<Container>()
+        .method<&Container::size>("size")
+        .bracketsOperator<&Container::at>();
+
+    bench_runner bench(std::move(o));
+
+    // lua -> c++
+    {
+        auto f = compile(vm, "return function(n) for i = 1, n do add(i, 1) end end");
+        bench.run("lua->c++ register_function<f>", [&](std::size_t n) { f.call<void>(n); });
+    }
+    {
+        auto f = compile(vm, "return function(n) for i = 1, n do add_noexcept(i, 1) end end");
+        bench.run("lua->c++ register_function<f> (noexcept)", [&](std::size_t n) { f.call<void>(n); });
+    }
+    {
+        auto f = compile(vm, "return function(n) for i = 1, n do add_unchecked(i, 1) end end");
+        bench.run("lua->c++ register_function<f> (unchecked)", [&](std::size_t n) { f.call<void>(n); });
+    }
+    {
+        auto f = compile(vm, "return function(n) for i = 1, n do add(i, 1) end end");
+        clg::profiler::set_enabled(true);
+        bench.run("lua->c++ register_function<f> (profiler on)", [&](std::size_t n) { f.call<void>(n); });
+        clg::profiler::set_enabled(false);
+    }
+    {
+        // ns/op is wall time divided by the iterations of a single thread; linear scaling keeps it equal to the single
+        // threaded result
+        const auto threadCount = std::max(2u, std::thread::hardware_concurrency());
+        vm_per_thread threads(threadCount, "return function(n) for i = 1, n do add(i, 1) end end");
+        const auto name = "lua->c++ register_function<f> x" + std::to_string(threadCount) + " vm/thread";
+        bench.run(name.c_str(), [&](std::size_t n) { threads.run(n); });
+    }
+    {
+        auto f = compile(vm, "local s = string.rep('x', 64) return function(n) for i = 1, n do string_length(s) end end");
+        bench.run("lua->c++ register_function (const std::string&)", [&](std::size_t n) { f.call<void>(n); });
+    }
+    {
+        auto f = compile(vm, "local s = string.rep('x', 64) return function(n) for i = 1, n do view_length(s) end end");
+        bench.run("lua->c++ register_function (std::string_view)", [&](std::size_t n) { f.call<void>(n); });
+    }
+    {
+        auto f = compile(vm, "return function(n) for i = 1, n do split_pair() end end");
+        bench.run("lua->c++ register_function (returns std::tuple)", [&](std::size_t n) { f.call<void>(n); });
+    }
+    {
+        auto f = compile(vm, "return function(n) for i = 1, n do add_lambda(i, 1) end end");
+        bench.run("lua->c++ register_function(lambda)", [&](std::size_t n) { f.call<void>(n); });
+    }
+    {
+        auto f = compile(vm, "return function(n) for i = 1, n do overloaded(i, 1) end end");
+        bench.run("lua->c++ register_function_overloaded", [&](std::size_t n) { f.call<void>(n); });
+    }
+    {
+        auto f = compile(vm, "return function(n) for i = 1, n do overloaded('abc') end end");
+        bench.run("lua->c++ register_function_overloaded (3rd)", [&](std::size_t n) { f.call<void>(n); });
+    }
+    {
+        auto object = std::make_shared<Counter>();
+        auto f = compile(vm, "return function(n, o) for i = 1, n do o:get() end end");
+        bench.run("lua->c++ class_registrar::method (getter)", [&](std::size_t n) { f.call<void>(n, object); });
+    }
+    {
+        auto object = std::make_shared<Counter>();
+        auto f = compile(vm, "return function(n, o) for i = 1, n do o:get_noexcept() end end");
+        bench.run("lua->c++ class_registrar::method (noexcept)", [&](std::size_t n) { f.call<void>(n, object); });
+    }
+    {
+        auto object = std::make_shared<Counter>();
+        auto f = compile(vm, "return function(n, o) for i = 1, n do o:set(i) end end");
+        bench.run("lua->c++ class_registrar::method (setter)", [&](std::size_t n) { f.call<void>(n, object); });
+    }
+    {
+        auto object = std::make_shared<Counter>();
+        auto f = compile(vm, "return function(n, o) for i = 1, n do o:set_unchecked(i) end end");
+        bench.run("lua->c++ class_registrar::method (unchecked)", [&](std::size_t n) { f.call<void>(n, object); });
+    }
+    {
+        auto object = std::make_shared<Entity>();
+        auto f = compile(vm, "return function(n, o) for i = 1, n do o:health() end end");
+        bench.run("lua->c++ class_registrar::method (lua_self)", [&](std::size_t n) { f.call<void>(n, object); });
+    }
+    {
+        auto object = std::make_shared<CompactEntity>();
+        auto f = compile(vm, "return function(n, o) for i = 1, n do o:health() end end");
+        bench.run("lua->c++ class_registrar::method (compact)", [&](std::size_t n) { f.call<void>(n, object); });
+    }
+    {
+        auto object = std::make_shared<Entity>();
+        auto f = compile(vm, "return function(n, o) o.field = 1 for i = 1, n do local _ = o.field end end");
+        bench.run("lua field read (lua_self)", [&](std::size_t n) { f.call<void>(n, object); });
+    }
+    {
+        auto object = std::make_shared<CompactEntity>();
+        auto f = compile(vm, "return function(n, o) o.field = 1 for i = 1, n do local _ = o.field end end");
+        bench.run("lua field read (compact_lua_self)", [&](std::size_t n) { f.call<void>(n, object); });
+    }
+    {
+        auto object = std::make_shared<Circle>();
+        auto f = compile(vm, "return function(n, o) for i = 1, n do o:get_id() end end");
+        bench.run("lua->c++ class_registrar::method (base class)", [&](std::size_t n) { f.call<void>(n, object); });
+    }
+    {
+        auto object = std::make_shared<CompactEntity>();
+        auto f = compile(vm, "return function(n, o) for i = 1, n do local _ = o.hp end end");
+        bench.run("lua->c++ class_registrar::property (get)", [&](std::size_t n) { f.call<void>(n, object); });
+    }
+    {
+        auto object = std::make_shared<CompactEntity>();
+        auto f = compile(vm, "return function(n, o) for i = 1, n do o.hp = i end end");
+        bench.run("lua->c++ class_registrar::property (set)", [&](std::size_t n) { f.call<void>(n, object); });
+    }
+    {
+        auto object = std::make_shared<CompactEntity>();
+        auto f = compile(vm, "return function(n, o) for i = 1, n do o:set_health(i) end end");
+        bench.run("lua->c++ class_registrar::method (set_health)", [&](std::size_t n) { f.call<void>(n, object); });
+    }
+    {
+        auto f = compile(vm, "return function(n) for i = 1, n do Counter.twice(i) end end");
+        bench.run("lua->c++ staticFunction", [&](std::size_t n) { f.call<void>(n); });
+    }
+    {
+        auto object = std::make_shared<Container>();
+        auto f = compile(vm, "return function(n, o) for i = 1, n do local _ = o[i] end end");
+        bench.run("lua->c++ bracketsOperator (operator)", [&](std::size_t n) { f.call<void>(n, object); });
+    }
+    {
+        auto object = std::make_shared<Container>();
+        auto f = compile(vm, "return function(n, o) for i = 1, n do o:size() end end");
+        bench.run("lua->c++ bracketsOperator (method)", [&](std::size_t n) { f.call<void>(n, object); });
+    }
+
+    // c++ -> lua
+    {
+        lua_State* L = vm;
+        auto object = std::make_shared<Counter>();
+        bench.run("push_to_lua(shared_ptr<T>)", [&](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                clg::push_to_lua(L, object);
+                lua_pop(L, 1);
+            }
+        });
+    }
+    {
+        lua_State* L = vm;
+        auto object = std::make_shared<Entity>();
+        bench.run("push_to_lua(shared_ptr<lua_self>) cached", [&](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                clg::push_to_lua(L, object);
+                lua_pop(L, 1);
+            }
+        });
+    }
+    {
+        lua_State* L = vm;
+        bench.run("push_to_lua(shared_ptr<lua_self>) first", [&](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                clg::push_to_lua(L, std::make_shared<Entity>());
+                lua_pop(L, 1);
+            }
+        });
+    }
+    {
+        lua_State* L = vm;
+        auto object = std::make_shared<CompactEntity>();
+        bench.run("push_to_lua(shared_ptr<compact>) cached", [&](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                clg::push_to_lua(L, object);
+                lua_pop(L, 1);
+            }
+        });
+    }
+    {
+        lua_State* L = vm;
+        bench.run("push_to_lua(shared_ptr<compact>) first", [&](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                clg::push_to_lua(L, std::make_shared<CompactEntity>());
+                lua_pop(L, 1);
+            }
+        });
+    }
+    {
+        lua_State* L = vm;
+        std::vector<std::shared_ptr<Counter>> objects(1000);
+        for (auto& o : objects) {
+            o = std::make_shared<Counter>();
+        }
+        bench.run("push_to_lua(vector<shared_ptr<T>>) (1000)", [&](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                clg::push_to_lua(L, objects);
+                lua_pop(L, 1);
+            }
+        });
+    }
+    {
+        lua_State* L = vm;
+        std::vector<std::shared_ptr<CompactEntity>> objects(1000);
+        for (auto& o : objects) {
+            o = std::make_shared<CompactEntity>();
+        }
+        // keeps the objects in lua, as scripts holding them between frames do
+        clg::push_to_lua(L, objects);
+        auto held = clg::ref::from_stack(L);
+        bench.run("push_to_lua(vector<shared_ptr<compact>>) (1000)", [&](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                clg::push_to_lua(L, objects);
+                lua_pop(L, 1);
+            }
+        });
+    }
+    {
+        lua_State* L = vm;
+        clg::table table;
+        for (int i = 0; i < 8; ++i) {
+            table.emplace_back("key" + std::to_string(i), clg::ref::from_cpp(L, i));
+        }
+        bench.run("converter<clg::table> round trip (8)", [&](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                clg::push_to_lua(L, table);
+                auto result = clg::pop_from_lua<clg::table>(L);
+            }
+        });
+    }
+    {
+        lua_State* L = vm;
+        std::vector<int> vector(16, 42);
+        bench.run("converter<std::vector<int>> round trip (16)", [&](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                clg::push_to_lua(L, vector);
+                auto result = clg::pop_from_lua<std::vector<int>>(L);
+            }
+        });
+    }
+    {
+        lua_State* L = vm;
+        std::vector<std::string> vector(16, "a string long enough to skip sso");
+        bench.run("converter<std::vector<std::string>> rt (16)", [&](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                clg::push_to_lua(L, vector);
+                auto result = clg::pop_from_lua<std::vector<std::string>>(L);
+            }
+        });
+    }
+    {
+        auto f = compile(vm, "return function(a, b) return a + b end");
+        bench.run("c++->lua clg::function::call", [&](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                f.call<int>(int(i), 1);
+            }
+        });
+    }
+    {
+        bench.run("state_interface::do_string (snippet)", [&](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                vm.do_string("local a = 1 + 2");
+            }
+        });
+    }
+    {
+        vm.set_bytecode_cache(std::make_shared<clg::bytecode_cache>(), true);
+        bench.run("state_interface::do_string (snippet, cached)", [&](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                vm.do_string("local a = 1 + 2");
+            }
+        });
+        vm.set_bytecode_cache(nullptr);
+    }
+    {
+        vm.set_chunk_cache_capacity(64);
+        bench.run("state_interface::do_string (chunk cache)", [&](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                vm.do_string("local a = 1 + 2");
+            }
+        });
+        vm.set_chunk_cache_capacity(0);
+    }
+    {
+        auto chunk = vm.compile("local a = 1 + 2");
+        bench.run("state_interface::do_string (compiled)", [&](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                vm.do_string(chunk);
+            }
+        });
+    }
+    {
+        bench.run("state_interface::do_embedded (snippet)", [&](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                vm.do_embedded<int>("bench_handler");
+            }
+        });
+    }
+
+    // vm lifecycle
+    {
+        const auto init = [](clg::vm& vm) {
+            vm.register_function<add>("add");
+            vm.register_class<Counter>()
+                .constructor<>()
+                .method<&Counter::get>("get")
+                .method<&Counter::set>("set")
+                .staticFunction<&Counter::twice>("twice");
+            vm.do_string("function handler(n) return add(n, Counter.twice(n)) end");
+        };
+        bench.run("clg::vm construct + init", [&](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                clg::vm fresh;
+                init(fresh);
+            }
+        });
+        clg::vm_pool pool(1, init);
+        bench.run("clg::vm_pool checkout + return", [&](std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) {
+                auto pooled = pool.checkout();
+                pooled->do_string("scratch = handler(1)");
+            }
+        });
+    }
+
+    return 0;
+}
@@ -0,0 +1,3 @@
+-- embedded into clg_bench by clg_embed_scripts()
+local a = 1 + 2
+return a
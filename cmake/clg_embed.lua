@@ -0,0 +1,40 @@
+--
+-- Generates a C++ source registering a precompiled Lua chunk in clg::embedded_chunks().
+--
+-- Usage: lua clg_embed.lua <source.lua> <output.cpp> <chunk name> <strip: 0|1>
+--
+
+local src, gen, name, strip = ...
+assert(src and gen and name, "usage: lua clg_embed.lua <source.lua> <output.cpp> <chunk name> [strip]")
+
+local chunk = assert(loadfile(src, "t"))
+local bytecode = string.dump(chunk, strip == "1")
+
+local function escape(s)
+   return (s:gsub('\\', '\\\\'):gsub('"', '\\"'))
+end
+
+local t = {}
+for i = 1, #bytecode, 16 do
+   local line = {}
+   for j = i, math.min(i + 15, #bytecode) do
+      line[#line + 1] = ("0x%02x,"):format(bytecode:byte(j))
+   end
+   t[#t + 1] = "        " .. table.concat(line, " ")
+end
+
+local out = assert(io.open(gen, "wb"))
+out:write(([[
+// generated by clg_embed_scripts() from %s; do not edit
+
+#include "embedded.hpp"
+
+namespace {
+    const unsigned char bytecode[] = {
+%s
+    };
+
+    const clg::embedded_chunk_registrar registrar("%s", bytecode, sizeof(bytecode));
+}
+]]):format(escape(src), table.concat(t, "\n"), escape(name)))
+out:close()
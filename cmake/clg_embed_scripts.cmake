@@ -0,0 +1,58 @@
+set(CLG_EMBED_GENERATOR "${CMAKE_CURRENT_LIST_DIR}/clg_embed.lua" CACHE INTERNAL "")
+set(CLG_LUA_EXECUTABLE "" CACHE FILEPATH
+    "Lua interpreter compiling embedded scripts; must produce bytecode for the target platform and backend. Defaults to the lua (or luajit) target")
+
+# clg_embed_scripts(<target> [BASE_DIR <dir>] [KEEP_DEBUG_INFO] <files>...)
+#
+# Compiles Lua sources at build time and links the bytecode into <target>. Chunks are named by their path relative to
+# BASE_DIR (defaults to the current source dir) with the extension dropped and separators replaced by dots, i.e.
+# scripts/net/http.lua with BASE_DIR scripts becomes "net.http", the name accepted by state_interface::do_embedded and
+# require (see state_interface::enable_embedded_require).
+#
+# Debug info is stripped unless KEEP_DEBUG_INFO is specified; stripped chunks report errors without line numbers.
+#
+# The chunks register themselves from static initializers, so <target> should be an executable, a shared library or an
+# object library: the linker may drop them from a static library.
+function(clg_embed_scripts TARGET)
+    cmake_parse_arguments(CLG_EMBED "KEEP_DEBUG_INFO" "BASE_DIR" "" ${ARGN})
+    if (NOT CLG_EMBED_BASE_DIR)
+        set(CLG_EMBED_BASE_DIR ${CMAKE_CURRENT_SOURCE_DIR})
+    endif()
+    get_filename_component(CLG_EMBED_BASE_DIR ${CLG_EMBED_BASE_DIR} ABSOLUTE)
+
+    if (CLG_LUA_EXECUTABLE)
+        set(LUA_COMMAND ${CLG_LUA_EXECUTABLE})
+        set(LUA_DEPENDENCY)
+    elseif (TARGET lua)
+        set(LUA_COMMAND $<TARGET_FILE:lua>)
+        set(LUA_DEPENDENCY lua)
+    elseif (TARGET luajit)
+        set(LUA_COMMAND $<TARGET_FILE:luajit>)
+        set(LUA_DEPENDENCY luajit)
+    else()
+        message(FATAL_ERROR "clg_embed_scripts: no lua interpreter to compile scripts with, set CLG_LUA_EXECUTABLE (or keep LUAJIT_BUILD_EXE ON)")
+    endif()
+
+    if (CLG_EMBED_KEEP_DEBUG_INFO)
+        set(STRIP 0)
+    else()
+        set(STRIP 1)
+    endif()
+
+    foreach(SCRIPT ${CLG_EMBED_UNPARSED_ARGUMENTS})
+        get_filename_component(SCRIPT ${SCRIPT} ABSOLUTE)
+        file(RELATIVE_PATH NAME ${CLG_EMBED_BASE_DIR} ${SCRIPT})
+        string(REGEX REPLACE "\\.lua$" "" NAME ${NAME})
+        string(REPLACE "/" "." NAME ${NAME})
+        string(MAKE_C_IDENTIFIER ${NAME} GENERATED_NAME)
+        set(GENERATED ${CMAKE_CURRENT_BINARY_DIR}/clg_embedded/${TARGET}/${GENERATED_NAME}.cpp)
+        add_custom_command(
+                OUTPUT ${GENERATED}
+                COMMAND ${CMAKE_COMMAND} -E make_directory ${CMAKE_CURRENT_BINARY_DIR}/clg_embedded/${TARGET}
+                COMMAND ${LUA_COMMAND} ${CLG_EMBED_GENERATOR} ${SCRIPT} ${GENERATED} ${NAME} ${STRIP}
+                DEPENDS ${SCRIPT} ${CLG_EMBED_GENERATOR} ${LUA_DEPENDENCY}
+                COMMENT "Compiling embedded Lua chunk ${NAME}"
+                VERBATIM)
+        target_sources(${TARGET} PRIVATE ${GENERATED})
+    endforeach()
+endfunction()
@@ -0,0 +1,373 @@
+#pragma once
+
+#include "lua.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace clg {
+
+    /**
+     * @brief Cache of compiled chunks (lua_dump output) keyed by a hash of the chunk name and the source.
+     * @details
+     * Compiled chunks are kept in memory and, if a directory is specified, in "<hash>.luac" files which are mmapped on
+     * load, so they survive process restarts. Up to capacity chunks are held in memory, least recently used are
+     * evicted (their files are kept). A single cache can be shared between several states (i.e. clg::vm_pool), all
+     * methods are thread safe.
+     *
+     * Every entry keeps the chunk name and the source it was compiled from, a hit is used only if both match exactly, so
+     * hash collisions and files from other sources are treated as misses. Cached bytecode is loaded with luaL_loadbufferx
+     * in binary mode. If it is rejected (i.e. the file was truncated or written by a different Lua version) the source is
+     * compiled again and the cache entry is replaced.
+     *
+     * @code{cpp}
+     * auto cache = std::make_shared<clg::bytecode_cache>("cache/luac");
+     * vm.set_bytecode_cache(cache);
+     * vm.do_file("scripts/common.lua"); // compiled once per content
+     * @endcode
+     */
+    class bytecode_cache {
+    public:
+        static constexpr std::size_t DEFAULT_CAPACITY = 1024;
+
+        /**
+         * @brief Memory only cache.
+         * @param capacity max number of compiled chunks held in memory
+         */
+        explicit bytecode_cache(std::size_t capacity = DEFAULT_CAPACITY): mCapacity(capacity) {}
+
+        /**
+         * @param directory directory for compiled chunks. Created if it does not exist.
+         * @param capacity max number of compiled chunks held in memory
+         */
+        explicit bytecode_cache(std::filesystem::path directory, std::size_t capacity = DEFAULT_CAPACITY):
+            mDirectory(std::move(directory)),
+            mCapacity(capacity)
+        {
+            std::filesystem::create_directories(*mDirectory);
+        }
+
+        bytecode_cache(const bytecode_cache&) = delete;
+        bytecode_cache& operator=(const bytecode_cache&) = delete;
+
+        /**
+         * @brief Pushes the compiled chunk like luaL_loadbuffer does.
+         * @return luaL_loadbuffer status: LUA_OK or an error code with the error message on the stack.
+         */
+        int load(lua_State* L, std::string_view source, const char* chunkName) {
+            const auto key = hash(chunkName, source);
+            if (auto compiled = find(key); compiled && compiled->matches(chunkName, source)) {
+                const auto bytecode = compiled->bytecode();
+                if (luaL_loadbufferx(L, bytecode.data(), bytecode.size(), chunkName, "b") == LUA_OK) {
+                    return LUA_OK;
+                }
+                lua_pop(L, 1); // stale or corrupted entry; compile again
+            }
+
+            if (auto status = luaL_loadbufferx(L, source.data(), source.size(), chunkName, "t"); status != LUA_OK) {
+                return status;
+            }
+            std::string image = chunk::make_header(chunkName, source);
+            CLG_LUA_DUMP(L, dump_writer, &image, 0);
+            store(key, std::move(image));
+            return LUA_OK;
+        }
+
+        /**
+         * @brief Drops compiled chunks held in memory. Files in the directory are kept.
+         */
+        void clear_memory() {
+            std::unique_lock lock(mSync);
+            mChunks.clear();
+            mChunksIndex.clear();
+        }
+
+        [[nodiscard]]
+        std::size_t memory_entries() const {
+            std::unique_lock lock(mSync);
+            return mChunks.size();
+        }
+
+        [[nodiscard]]
+        std::size_t capacity() const noexcept {
+            return mCapacity;
+        }
+
+        [[nodiscard]]
+        const std::optional<std::filesystem::path>& directory() const noexcept {
+            return mDirectory;
+        }
+
+        /**
+         * @brief 64-bit FNV-1a of the chunk name and the source.
+         */
+        static std::uint64_t hash(std::string_view chunkName, std::string_view source) noexcept {
+            std::uint64_t h = 0xcbf29ce484222325ull;
+            auto feed = [&](std::string_view data) {
+                for (unsigned char c : data) {
+                    h ^= c;
+                    h *= 0x100000001b3ull;
+                }
+            };
+            feed(LUA_VERSION);
+            feed({"\0", 1});
+            feed(chunkName);
+            feed({"\0", 1});
+            feed(source);
+            return h;
+        }
+
+    private:
+        /**
+         * @brief Cache entry image, either owned (freshly compiled) or mmapped from the cache directory:
+         * header, chunk name, source, bytecode.
+         */
+        class chunk {
+        public:
+            struct header {
+                char magic[4];
+                std::uint32_t format;
+                std::uint64_t chunkNameSize;
+                std::uint64_t sourceSize;
+            };
+
+            static constexpr char MAGIC[4] = { 'C', 'L', 'G', 'C' };
+            static constexpr std::uint32_t FORMAT = 1;
+
+            /**
+             * @return header, chunk name and source; append the bytecode to get a complete image.
+             */
+            static std::string make_header(std::string_view chunkName, std::string_view source) {
+                header h{};
+                std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+                h.format = FORMAT;
+                h.chunkNameSize = chunkName.size();
+                h.sourceSize = source.size();
+                std::string result(reinterpret_cast<const char*>(&h), sizeof(h));
+                result += chunkName;
+                result += source;
+                return result;
+            }
+
+            explicit chunk(std::string image): mBytes(std::move(image)), mData(mBytes.data()), mSize(mBytes.size()) {
+                parse();
+            }
+
+            chunk(const char* mapped, std::size_t size): mData(mapped), mSize(size), mMapped(true) {
+                parse();
+            }
+
+            ~chunk() {
+#if !defined(_WIN32)
+                if (mMapped) {
+                    munmap(const_cast<char*>(mData), mSize);
+                }
+#endif
+            }
+
+            chunk(const chunk&) = delete;
+            chunk& operator=(const chunk&) = delete;
+
+            /**
+             * @return false if the image is truncated or was not written by this cache.
+             */
+            [[nodiscard]]
+            bool valid() const noexcept {
+                return !mBytecode.empty();
+            }
+
+            [[nodiscard]]
+            bool matches(std::string_view chunkName, std::string_view source) const noexcept {
+                return valid() && mChunkName == chunkName && mSource == source;
+            }
+
+            [[nodiscard]]
+            std::string_view bytecode() const noexcept {
+                return mBytecode;
+            }
+
+            [[nodiscard]]
+            std::string_view image() const noexcept {
+                return { mData, mSize };
+            }
+
+        private:
+            std::string mBytes;
+            const char* mData;
+            std::size_t mSize;
+            bool mMapped = false;
+            std::string_view mChunkName;
+            std::string_view mSource;
+            std::string_view mBytecode;
+
+            void parse() noexcept {
+                header h{};
+                if (mSize < sizeof(h)) {
+                    return;
+                }
+                std::memcpy(&h, mData, sizeof(h));
+                std::size_t rest = mSize - sizeof(h);
+                if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0 || h.format != FORMAT ||
+                    h.chunkNameSize > rest || h.sourceSize > rest - h.chunkNameSize) {
+                    return;
+                }
+                const char* p = mData + sizeof(h);
+                mChunkName = { p, std::size_t(h.chunkNameSize) };
+                mSource = { p + h.chunkNameSize, std::size_t(h.sourceSize) };
+                mBytecode = { p + h.chunkNameSize + h.sourceSize, std::size_t(rest - h.chunkNameSize - h.sourceSize) };
+            }
+        };
+
+        struct entry {
+            std::uint64_t key;
+            std::shared_ptr<const chunk> bytecode;
+        };
+
+        std::optional<std::filesystem::path> mDirectory;
+        std::size_t mCapacity;
+        mutable std::mutex mSync;
+
+        /**
+         * @brief Chunks held in memory, most recently used first.
+         */
+        std::list<entry> mChunks;
+        std::unordered_map<std::uint64_t, std::list<entry>::iterator> mChunksIndex;
+
+        static int dump_writer(lua_State*, const void* p, size_t size, void* ud) {
+            static_cast<std::string*>(ud)->append(static_cast<const char*>(p), size);
+            return 0;
+        }
+
+        [[nodiscard]]
+        std::filesystem::path file_path(std::uint64_t key) const {
+            char name[32];
+            std::snprintf(name, sizeof(name), "%016llx.luac", static_cast<unsigned long long>(key));
+            return *mDirectory / name;
+        }
+
+        std::shared_ptr<const chunk> find(std::uint64_t key) {
+            {
+                std::unique_lock lock(mSync);
+                if (auto it = mChunksIndex.find(key); it != mChunksIndex.end()) {
+                    mChunks.splice(mChunks.begin(), mChunks, it->second);
+                    return it->second->bytecode;
+                }
+            }
+            if (!mDirectory) {
+                return nullptr;
+            }
+            auto loaded = read_file(file_path(key));
+            if (!loaded || !loaded->valid()) {
+                return nullptr;
+            }
+            std::unique_lock lock(mSync);
+            put(key, loaded);
+            return loaded;
+        }
+
+        void store(std::uint64_t key, std::string image) {
+            auto compiled = std::make_shared<const chunk>(std::move(image));
+            if (mDirectory) {
+                write_file(file_path(key), compiled->image());
+            }
+            std::unique_lock lock(mSync);
+            put(key, std::move(compiled));
+        }
+
+        /**
+         * @brief Inserts or replaces the chunk as the most recently used one. Expects mSync to be locked.
+         */
+        void put(std::uint64_t key, std::shared_ptr<const chunk> bytecode) {
+            if (auto it = mChunksIndex.find(key); it != mChunksIndex.end()) {
+                it->second->bytecode = std::move(bytecode);
+                mChunks.splice(mChunks.begin(), mChunks, it->second);
+                return;
+            }
+            if (mCapacity == 0) {
+                return;
+            }
+            if (mChunks.size() >= mCapacity) {
+                mChunksIndex.erase(mChunks.back().key);
+                mChunks.pop_back();
+            }
+            mChunks.push_front({ key, std::move(bytecode) });
+            mChunksIndex[key] = mChunks.begin();
+        }
+
+        static std::shared_ptr<const chunk> read_file(const std::filesystem::path& path) {
+#if defined(_WIN32)
+            std::ifstream fis(path, std::ios::binary);
+            if (!fis) {
+                return nullptr;
+            }
+            std::string bytes((std::istreambuf_iterator<char>(fis)), std::istreambuf_iterator<char>());
+            if (bytes.empty()) {
+                return nullptr;
+            }
+            return std::make_shared<const chunk>(std::move(bytes));
+#else
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return nullptr;
+            }
+            struct stat st{};
+            if (fstat(fd, &st) != 0 || st.st_size == 0) {
+                ::close(fd);
+                return nullptr;
+            }
+            void* mapped = mmap(nullptr, std::size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (mapped == MAP_FAILED) {
+                return nullptr;
+            }
+            return std::make_shared<const chunk>(static_cast<const char*>(mapped), std::size_t(st.st_size));
+#endif
+        }
+
+        static void write_file(const std::filesystem::path& path, std::string_view bytes) {
+            // write to a temporary file and rename it, so concurrent readers (other states or processes) never see a
+            // partially written chunk
+            auto tmp = path;
+            tmp += ".tmp" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()) ^
+                                           std::size_t(std::chrono::steady_clock::now().time_since_epoch().count()));
+            {
+                std::ofstream fos(tmp, std::ios::binary | std::ios::trunc);
+                if (!fos) {
+                    return;
+                }
+                fos.write(bytes.data(), std::streamsize(bytes.size()));
+                if (!fos) {
+                    fos.close();
+                    std::error_code ec;
+                    std::filesystem::remove(tmp, ec);
+                    return;
+                }
+            }
+            std::error_code ec;
+            std::filesystem::rename(tmp, path, ec);
+            if (ec) {
+                std::filesystem::remove(tmp, ec);
+            }
+        }
+    };
+}
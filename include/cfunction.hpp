@@ -2,6 +2,9 @@
 
 #include "lua.hpp"
 #include "exception.hpp"
+#include "profiler.hpp"
+#include <string>
+#include <utility>
 
 
 namespace clg {
@@ -11,33 +14,166 @@ namespace clg {
     struct builder_return_type {};
 
 
+    /**
+     * @brief Binding policy (default): the argument count and types are validated, failures are reported to lua.
+     */
+    struct checked {};
+
+    /**
+     * @brief Binding policy for functions called only by trusted scripts, i.e. register_function<f, clg::unchecked>.
+     * @details
+     * Numbers, booleans and strings are read straight off the stack with lua_to* without any count or type check: a
+     * missing or mistyped argument silently becomes 0, false or an empty string. Other argument types are still
+     * converted by their converter. Exceptions thrown by the function are handled the same way as in checked mode.
+     */
+    struct unchecked {};
+
+
     static constexpr int OVERLOADED_HELPER_SUBSTITUTION_FAILURE = -228;
     namespace detail {
+        template<typename Policy>
+        static constexpr bool is_unchecked = std::is_same_v<Policy, unchecked>;
+
+        template<typename Policy>
+        static constexpr bool is_binding_policy = std::is_same_v<Policy, checked> || std::is_same_v<Policy, unchecked>;
+
+        /**
+         * @brief Reads an argument of clg::unchecked bindings without validation. Types without a specialization are
+         * converted by their converter.
+         */
+        template<typename T, typename EnableIf = void>
+        struct unchecked_argument: std::false_type {};
+
+        template<typename T>
+        struct unchecked_argument<T, std::enable_if_t<std::is_integral_v<T> || std::is_enum_v<T>>>: std::true_type {
+            static T read(lua_State* s, int n) noexcept {
+                if constexpr (std::is_same_v<T, bool>) {
+                    return lua_toboolean(s, n);
+                } else {
+                    return static_cast<T>(lua_tointeger(s, n));
+                }
+            }
+        };
+
+        template<typename T>
+        struct unchecked_argument<T, std::enable_if_t<std::is_floating_point_v<T>>>: std::true_type {
+            static T read(lua_State* s, int n) noexcept {
+                return static_cast<T>(lua_tonumber(s, n));
+            }
+        };
+
+        template<>
+        struct unchecked_argument<std::string_view>: std::true_type {
+            static std::string_view read(lua_State* s, int n) noexcept {
+                std::size_t len = 0;
+                auto data = lua_tolstring(s, n, &len);
+                return data ? std::string_view(data, len) : std::string_view();
+            }
+        };
+
+        template<>
+        struct unchecked_argument<std::string>: std::true_type {
+            static std::string read(lua_State* s, int n) {
+                return std::string(unchecked_argument<std::string_view>::read(s, n));
+            }
+        };
+
+        template<>
+        struct unchecked_argument<const char*>: std::true_type {
+            static const char* read(lua_State* s, int n) noexcept {
+                auto data = lua_tostring(s, n);
+                return data ? data : "";
+            }
+        };
+
+        template<>
+        struct unchecked_argument<lua_State*>: std::true_type {
+            static lua_State* read(lua_State* s, int) noexcept {
+                return s;
+            }
+        };
+
+        /**
+         * @brief Argument which failed to convert.
+         */
+        struct conversion_failure {
+            const char* message = nullptr;
+
+            /**
+             * @brief Lua stack index of the argument.
+             */
+            int index = 0;
+        };
+
+
+        /**
+         * @brief Argument types pointing into the lua value they were converted from.
+         */
+        template<typename T>
+        struct borrows_lua_value: std::false_type {};
+        template<> struct borrows_lua_value<std::string_view>: std::true_type {};
+        template<> struct borrows_lua_value<const char*>: std::true_type {};
 
-        template<typename... TupleArgs>
-        struct tuple_fill_from_lua_helper {
-            lua_State* l;
-            tuple_fill_from_lua_helper(lua_State* l) : l(l) {}
+        /**
+         * @brief Argument types whose conversion from lua reports failures through converter_error only and does not
+         * allocate (std::string may throw std::bad_alloc).
+         */
+        template<typename T>
+        struct nothrow_argument: std::bool_constant<std::is_arithmetic_v<T> || std::is_enum_v<T>> {};
+        template<> struct nothrow_argument<std::string_view>: std::true_type {};
+        template<> struct nothrow_argument<const char*>: std::true_type {};
+        template<> struct nothrow_argument<lua_State*>: std::true_type {};
+        template<typename T> struct nothrow_argument<std::shared_ptr<T>>: std::true_type {};
 
-            using target_tuple = std::tuple<TupleArgs...>;
+        /**
+         * @brief Return types pushed to lua without throwing.
+         */
+        template<typename T>
+        struct nothrow_result: std::bool_constant<std::is_void_v<T> || std::is_arithmetic_v<T> || std::is_enum_v<T>> {};
+        template<> struct nothrow_result<std::string>: std::true_type {};
+        template<> struct nothrow_result<std::string_view>: std::true_type {};
+        template<> struct nothrow_result<const char*>: std::true_type {};
 
-            template<unsigned tupleIndex>
-            std::optional<clg::converter_error> fill(target_tuple& t, int luaIndex = tupleIndex) {
-                return std::nullopt;
+
+        /**
+         * @brief Profiler name and counters of a generated lua_CFunction.
+         * @tparam Instance type providing static int call(lua_State*)
+         */
+        using binding_stats_ptr = profiler::binding_stats*;
+
+        template<typename Instance>
+        struct named_binding {
+            /**
+             * @brief Profiler counters of this binding. Assigned by set_trace_name on registration.
+             */
+            static std::atomic<profiler::binding_stats*>& binding() noexcept {
+                static std::atomic<profiler::binding_stats*> v = nullptr;
+                return v;
+            }
+
+            static std::string_view trace_name() noexcept {
+                auto b = binding().load(std::memory_order_relaxed);
+                return b ? std::string_view(b->name) : "unknown";
             }
 
-            template<unsigned tupleIndex, typename Arg, typename... Args>
-            std::optional<clg::converter_error>fill(target_tuple& t, int luaIndex = tupleIndex) {
-                clg::converter_result<Arg> r = clg::get_from_lua_raw<Arg>(l, luaIndex + 1);
-                if (r.is_error()) {
-                    return r.error();
+            /**
+             * @brief Names the binding for clg::profiler. The first assigned name is kept, so registering the same
+             * binding in several states does not race.
+             */
+            static void set_trace_name(std::string_view name) {
+                if (binding().load(std::memory_order_acquire) != nullptr) {
+                    return;
                 }
-                std::get<tupleIndex>(t) = std::move(*r);
-                if constexpr (std::is_same_v<lua_State*, Arg>) {
-                    // lua_State* is not taken from lua; we should omit it's index
-                    return fill<tupleIndex + 1, Args...>(t, luaIndex);
+                auto& stats = profiler::binding(name, profiler::direction::lua_to_cpp);
+                profiler::binding_stats* expected = nullptr;
+                if (binding().compare_exchange_strong(expected, &stats)) {
+                    profiler::name_function(Instance::call, stats);
                 }
-                return fill<tupleIndex + 1, Args...>(t, luaIndex + 1);
+            }
+
+        protected:
+            static binding_stats_ptr profiled() noexcept {
+                return profiler::enabled() ? binding().load(std::memory_order_relaxed) : nullptr;
             }
         };
 
@@ -48,108 +184,295 @@ namespace clg {
 
             static constexpr bool is_vararg = std::is_same_v<std::tuple<Args...>, std::tuple<vararg>>;
 
-            template<function_t f, bool passthroughSubstitutionError = false>
-            struct instance {
-                static int call(lua_State* s) {
-                    clg::check_thread();
-                    clg::impl::raii_state_updater updater(s);
-                    
-#if !CLG_MANUAL_CLEANUP
-                    clean_temp_table(s);
-#endif
+            /**
+             * @brief std::string_view and const char* arguments point into lua strings, so the arguments stay on the
+             * stack until the function returns instead of being popped before the call.
+             * @details
+             * These are the zero-copy string parameters. A const std::string& can not view a lua string: std::string
+             * owns its characters, so such arguments are copied (without allocating up to the small string size).
+             * Binding them to reused buffers instead would leak the buffers whenever the call is left with a lua
+             * error (longjmp), which skips C++ destructors.
+             */
+            static constexpr bool keeps_arguments = (false || ... || borrows_lua_value<std::decay_t<Args>>::value);
 
-                    const size_t expectedArgCount = (0 + ... + int(!std::is_same_v<lua_State*, Args>));
-                    try {
-                        size_t argsCount = lua_gettop(s);
-
-                        if constexpr (!is_vararg) {
-                            if constexpr (passthroughSubstitutionError) {
-                                if (argsCount != expectedArgCount) {
-                                    return OVERLOADED_HELPER_SUBSTITUTION_FAILURE;
-                                }
-                            } else {
-                                if (argsCount < expectedArgCount) {
-                                    throw clg_exception("invalid argument count! expected "
-                                                                + std::to_string(sizeof...(Args))
-                                                                + ", actual " + std::to_string(argsCount));
-                                }
-                            }
-                        }
+            /**
+             * @brief Whether a noexcept function with this signature can use nothrow_instance: conversions and the
+             * result push never throw, so no try/catch is needed.
+             */
+            static constexpr bool supports_nothrow = !is_vararg &&
+                                                     nothrow_result<std::decay_t<Return>>::value &&
+                                                     (true && ... && nothrow_argument<std::decay_t<Args>>::value);
 
-                        std::tuple<std::decay_t<Args>...> argsTuple;
+            /**
+             * @brief Converts the arguments one by one directly into converter_results living on the stack and passes
+             * them (as rvalues) to then. No argument is default constructed, copied or moved in between.
+             * @tparam Policy clg::checked or clg::unchecked (unchecked_argument types are read without validation).
+             * @return then's result or OVERLOADED_HELPER_SUBSTITUTION_FAILURE with failure filled in.
+             */
+            template<typename Policy, std::size_t I = 0, int luaIndex = 1, typename Then, typename... Converted>
+            static int convert_arguments(lua_State* s, conversion_failure& failure, Then&& then, Converted&... converted) {
+                if constexpr (I == sizeof...(Args)) {
+                    return then(std::move(converted)...);
+                } else {
+                    using arg_t = std::decay_t<std::tuple_element_t<I, std::tuple<Args...>>>;
+                    // lua_State* is not taken from lua; it does not occupy a stack index
+                    constexpr int nextLuaIndex = std::is_same_v<lua_State*, arg_t> ? luaIndex : luaIndex + 1;
 
-                        if (auto error = tuple_fill_from_lua_helper<std::decay_t<Args>...>(s).template fill<0, std::decay_t<Args>...>(argsTuple)) {
-                            if constexpr (passthroughSubstitutionError) {
-                                return OVERLOADED_HELPER_SUBSTITUTION_FAILURE;
-                            }
-                            throw clg_exception(error->errorLiteral ? error->errorLiteral : "unknown converter failure");
+                    if constexpr (is_unchecked<Policy> && unchecked_argument<arg_t>::value) {
+                        arg_t value = unchecked_argument<arg_t>::read(s, luaIndex);
+                        return convert_arguments<Policy, I + 1, nextLuaIndex>(s, failure, std::forward<Then>(then), converted..., value);
+                    } else {
+                        clg::converter_result<arg_t> r = clg::get_from_lua_raw<arg_t>(s, luaIndex);
+                        if (r.is_error()) {
+                            failure.message = r.error().errorLiteral ? r.error().errorLiteral : "unknown converter failure";
+                            failure.index = luaIndex;
+                            return OVERLOADED_HELPER_SUBSTITUTION_FAILURE;
                         }
+                        return convert_arguments<Policy, I + 1, nextLuaIndex>(s, failure, std::forward<Then>(then), converted..., *r);
+                    }
+                }
+            }
+
+            /**
+             * @brief Removes the arguments before the function is called. Unchecked bindings do not know how many
+             * arguments were actually passed, so they clear the stack instead of popping.
+             */
+            template<typename Policy>
+            static void pop_arguments(lua_State* s, int count, int keep = 0) noexcept {
+                if constexpr (keeps_arguments) {
+                    return;
+                } else if constexpr (is_unchecked<Policy>) {
+                    lua_settop(s, keep);
+                } else {
+                    lua_pop(s, count - keep);
+                }
+            }
 
+            /**
+             * @brief Converts arguments from the lua stack, invokes f and pushes its result.
+             * @param f function pointer or callable object accepting Args...
+             */
+            template<bool passthroughSubstitutionError, typename Policy = checked, typename Function>
+            static int invoke(lua_State* s, Function&& f) {
+                static_assert(is_binding_policy<Policy>, "Policy is expected to be clg::checked or clg::unchecked");
+                clg::check_thread();
+                clg::impl::raii_state_updater updater(s);
 
-#if CLG_TRACE_CALLS
-                        assert(trace_name() != "unknown");
-                        printf("[clg] trace call %s(", trace_name().c_str());
-                        for (int i = 1; i <= argsCount; ++i) {
-                            if (i != 1) {
-                                printf(", ");
+#if !CLG_MANUAL_CLEANUP
+                clean_temp_table(s);
+#endif
+
+                const size_t expectedArgCount = (0 + ... + int(!std::is_same_v<lua_State*, Args>));
+                try {
+                    size_t argsCount = lua_gettop(s);
+
+                    if constexpr (!is_vararg && !is_unchecked<Policy>) {
+                        if constexpr (passthroughSubstitutionError) {
+                            if (argsCount != expectedArgCount) {
+                                return OVERLOADED_HELPER_SUBSTITUTION_FAILURE;
                             }
-                            if (lua_istable(s, i)) {
-                                printf("<table>");
-                                continue;
+                        } else {
+                            if (argsCount < expectedArgCount) {
+                                throw clg_exception("invalid argument count! expected "
+                                                            + std::to_string(sizeof...(Args))
+                                                            + ", actual " + std::to_string(argsCount));
                             }
-                            printf("%s", clg::any_to_string(s, i, 1, false).c_str());
                         }
-                        printf(")\n");
-#endif
+                    }
 
+                    conversion_failure failure;
+                    auto r = convert_arguments<Policy>(s, failure, [&](auto&&... args) {
                         if constexpr (std::is_same_v<Return, builder_return_type>) {
-                            lua_pop(s, expectedArgCount - 1);
-                            (std::apply)(f, std::move(argsTuple));
+                            pop_arguments<Policy>(s, expectedArgCount, 1);
+                            f(std::forward<decltype(args)>(args)...);
+                            if constexpr (keeps_arguments) {
+                                lua_settop(s, 1);
+                            }
                             return 1;
                         } else if constexpr (std::is_void_v<Return>) {
-                            lua_pop(s, expectedArgCount);
+                            pop_arguments<Policy>(s, expectedArgCount);
                             // ничего не возвращается
-                            (std::apply)(f, std::move(argsTuple));
+                            f(std::forward<decltype(args)>(args)...);
                             return 0;
                         } else {
                             if constexpr (!is_vararg) {
-                                lua_pop(s, expectedArgCount);
+                                pop_arguments<Policy>(s, expectedArgCount);
                             }
                             // возвращаем одно значение
-                            return clg::push_to_lua(s, (std::apply)(f, std::move(argsTuple)));
+                            return clg::push_to_lua(s, f(std::forward<decltype(args)>(args)...));
                         }
-                    } catch (const std::exception& e) {
-                        if (clg::function::exception_callback()) {
-                            clg::function::exception_callback()(s);
+                    });
+                    if (r == OVERLOADED_HELPER_SUBSTITUTION_FAILURE) {
+                        if constexpr (passthroughSubstitutionError) {
+                            return OVERLOADED_HELPER_SUBSTITUTION_FAILURE;
                         }
-                        clg::push_to_lua(s, nullptr);
-                        clg::push_to_lua(s, e.what());
-                        return 2;
+                        throw clg_exception(failure.message);
+                    }
+                    return r;
+                } catch (const std::exception& e) {
+                    if (clg::function::exception_callback()) {
+                        clg::function::exception_callback()(s);
                     }
+                    clg::push_to_lua(s, nullptr);
+                    clg::push_to_lua(s, e.what());
+                    return 2;
                 }
+            }
 
-#if CLG_TRACE_CALLS
-                static std::string& trace_name() {
-                    static std::string name = "unknown";
-                    return name;
-                }
+            /**
+             * @brief invoke() for noexcept functions with supports_nothrow signatures.
+             * @return number of results or, if an argument could not be converted, minus its stack index with the
+             * converter's message in error.
+             */
+            template<typename Policy = checked, typename Function>
+            static int invoke_nothrow(lua_State* s, Function&& f, const char*& error) noexcept {
+                static_assert(supports_nothrow);
+                static_assert(is_binding_policy<Policy>, "Policy is expected to be clg::checked or clg::unchecked");
+                clg::check_thread();
+                clg::impl::raii_state_updater updater(s);
+
+#if !CLG_MANUAL_CLEANUP
+                clean_temp_table(s);
 #endif
+
+                const int expectedArgCount = (0 + ... + int(!std::is_same_v<lua_State*, Args>));
+                conversion_failure failure;
+                auto r = convert_arguments<Policy>(s, failure, [&](auto&&... args) {
+                    pop_arguments<Policy>(s, expectedArgCount);
+                    if constexpr (std::is_void_v<Return>) {
+                        f(std::forward<decltype(args)>(args)...);
+                        return 0;
+                    } else {
+                        return clg::push_to_lua(s, f(std::forward<decltype(args)>(args)...));
+                    }
+                });
+                if (r == OVERLOADED_HELPER_SUBSTITUTION_FAILURE) {
+                    error = failure.message;
+                    return -failure.index;
+                }
+                return r;
+            }
+
+            /**
+             * @brief Raises the lua error reported by invoke_nothrow. Called after every C++ object of the call is
+             * destroyed since lua_error does not unwind them.
+             */
+            static int raise_nothrow_error(lua_State* s, int r, const char* error) {
+                if (r < 0) {
+                    return luaL_argerror(s, -r, error);
+                }
+                return r;
+            }
+
+            /**
+             * @brief lua_CFunction of a noexcept function without exception handling. Conversion failures are raised
+             * with luaL_argerror instead of being returned as (nil, message).
+             */
+            template<function_t f, typename Policy = checked>
+            struct nothrow_instance: named_binding<nothrow_instance<f, Policy>> {
+                static int call(lua_State* s) {
+                    const char* error = nullptr;
+                    int r;
+                    {
+                        profiler::call_scope profile(nothrow_instance::profiled());
+                        r = invoke_nothrow<Policy>(s, f, error);
+                    }
+                    return raise_nothrow_error(s, r, error);
+                }
+            };
+
+            template<typename Callable, typename Policy = checked>
+            struct nothrow_closure_instance: named_binding<nothrow_closure_instance<Callable, Policy>> {
+                static int call(lua_State* s) {
+                    const char* error = nullptr;
+                    int r;
+                    {
+                        profiler::call_scope profile(nothrow_closure_instance::profiled());
+                        r = invoke_nothrow<Policy>(s, *static_cast<Callable*>(lua_touserdata(s, lua_upvalueindex(1))), error);
+                    }
+                    return raise_nothrow_error(s, r, error);
+                }
+            };
+
+            template<function_t f, bool passthroughSubstitutionError = false, typename Policy = checked>
+            struct instance: named_binding<instance<f, passthroughSubstitutionError, Policy>> {
+                static int call(lua_State* s) {
+                    profiler::call_scope profile(instance::profiled());
+                    return invoke<passthroughSubstitutionError, Policy>(s, f);
+                }
+            };
+
+            /**
+             * @brief lua_CFunction invoking a Callable stored in the first upvalue of the C closure (see
+             * clg::push_callable_closure).
+             */
+            template<typename Callable, bool passthroughSubstitutionError = false, typename Policy = checked>
+            struct closure_instance: named_binding<closure_instance<Callable, passthroughSubstitutionError, Policy>> {
+                static int call(lua_State* s) {
+                    profiler::call_scope profile(closure_instance::profiled());
+                    return invoke<passthroughSubstitutionError, Policy>(s, *static_cast<Callable*>(lua_touserdata(s, lua_upvalueindex(1))));
+                }
             };
         };
 
+        template<typename F>
+        struct is_noexcept_function: std::false_type {};
+        template<typename Return, typename... Args>
+        struct is_noexcept_function<Return(*)(Args...) noexcept>: std::true_type {};
+
         template<typename Return, typename... Args>
         static register_function_helper<Return, Args...> make_register_function_helper(Return(*)(Args...)) {
             return {};
         }
+
+        /**
+         * @brief nothrow_instance if f is noexcept and its signature supports it, instance otherwise.
+         */
+        template<auto f, typename Policy = checked, typename Helper = decltype(make_register_function_helper(f))>
+        using function_instance = std::conditional_t<is_noexcept_function<decltype(f)>::value && Helper::supports_nothrow,
+                                                     typename Helper::template nothrow_instance<f, Policy>,
+                                                     typename Helper::template instance<f, false, Policy>>;
     }
 
-    template<auto f>
-    static constexpr lua_CFunction cfunction(const std::string& name /* for trace */) {
-        using my_register_function_helper = decltype(detail::make_register_function_helper(f));
-        using my_instance = typename my_register_function_helper::template instance<f>;
-#if CLG_TRACE_CALLS
-        my_instance::trace_name() = name;
-#endif
+    /**
+     * @tparam Policy clg::checked (default) or clg::unchecked
+     */
+    template<auto f, typename Policy = checked>
+    static lua_CFunction cfunction(std::string_view name /* for clg::profiler */) {
+        using my_instance = detail::function_instance<f, Policy>;
+        my_instance::set_trace_name(name);
         return my_instance::call;
     }
+
+    /**
+     * @brief Pushes a full userdata owning a copy of callable. The userdata's __gc destroys the callable, so it lives
+     * exactly as long as the closures referencing it.
+     */
+    template<typename Callable>
+    void push_callable_userdata(lua_State* L, Callable&& callable) {
+        using callable_t = std::decay_t<Callable>;
+        static_assert(alignof(callable_t) <= alignof(void*) || alignof(callable_t) <= alignof(lua_Number),
+                      "lua userdata does not satisfy alignment of the callable");
+        new (lua_newuserdata(L, sizeof(callable_t))) callable_t(std::forward<Callable>(callable));
+
+        if constexpr (!std::is_trivially_destructible_v<callable_t>) {
+            // one metatable per callable type per state
+            static const char key = 0;
+            lua_pushlightuserdata(L, const_cast<char*>(&key));
+            lua_rawget(L, LUA_REGISTRYINDEX);
+            if (lua_isnil(L, -1)) {
+                lua_pop(L, 1);
+                lua_createtable(L, 0, 1);
+                lua_pushcfunction(L, [](lua_State* l) {
+                    static_cast<callable_t*>(lua_touserdata(l, 1))->~callable_t();
+                    return 0;
+                });
+                lua_setfield(L, -2, "__gc");
+                lua_pushlightuserdata(L, const_cast<char*>(&key));
+                lua_pushvalue(L, -2);
+                lua_rawset(L, LUA_REGISTRYINDEX);
+            }
+            lua_setmetatable(L, -2);
+        }
+    }
 }
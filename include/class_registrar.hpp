@@ -6,30 +6,20 @@
 
 #include "clg.hpp"
 #include "table.hpp"
+#include "object_expose.hpp"
 #include <vector>
 #include <cassert>
 #include <cstdio>
+#include <utility>
 
 namespace clg {
     namespace impl {
-#if LUA_VERSION_NUM == 501
-        static void newlib(lua_State* L, const std::vector<luaL_Reg>& l) {
-            lua_createtable(L, 0, l.size() - 1);
-            luaL_setfuncs(L, l.data(), 0);
-        }
-#else
-    static void newlib(lua_State* L, const std::vector<luaL_Reg>& l) {
-        luaL_newlib(L, const_cast<std::vector<luaL_Reg>&>(l).data());
-    }
-#endif
         static void newlib(lua_State* L, const lua_cfunctions& l) {
-            std::vector<luaL_Reg> reg;
-            reg.reserve(l.size() + 1);
+            lua_createtable(L, 0, int(l.size()));
             for (const auto& c : l) {
-                reg.push_back({c.name.c_str(), c.cFunction});
+                c.push(L);
+                lua_setfield(L, -2, c.name.c_str());
             }
-            reg.push_back({nullptr, nullptr});
-            newlib(L, reg);
         }
 
         template<typename T>
@@ -41,6 +31,69 @@ namespace clg {
 
     }
 
+    namespace detail {
+        /**
+         * @brief self argument of method bindings: the object borrowed from its lua userdata.
+         * @details
+         * Unlike std::shared_ptr<C> it costs no refcount operations. The object is kept alive by its lua value, which
+         * stays on the stack until the method returns (see borrows_lua_value); releasing it from the helper (i.e.
+         * :destroy() called from within the method) is deferred until the call returns. Fails to convert from nil, so
+         * noexcept methods report it with luaL_argerror.
+         */
+        template<class C>
+        class method_self {
+        public:
+            method_self(C* ptr, shared_ptr_helper* helper) noexcept: ptr(ptr), mHelper(helper) {
+                mHelper->begin_borrow();
+            }
+
+            method_self(method_self&& other) noexcept: ptr(other.ptr), mHelper(std::exchange(other.mHelper, nullptr)) {}
+
+            method_self(const method_self&) = delete;
+            method_self& operator=(const method_self&) = delete;
+            method_self& operator=(method_self&&) = delete;
+
+            ~method_self() {
+                if (mHelper) {
+                    mHelper->end_borrow();
+                }
+            }
+
+            C* ptr;
+
+        private:
+            shared_ptr_helper* mHelper;
+        };
+
+        template<class C>
+        struct nothrow_argument<method_self<C>>: std::true_type {};
+
+        // the userdata owns the object, so it must not be popped (and collected) while the method runs
+        template<class C>
+        struct borrows_lua_value<method_self<C>>: std::true_type {};
+    }
+
+    template<class C>
+    struct converter<detail::method_self<C>> {
+        static converter_result<detail::method_self<C>> from_lua(lua_State* l, int n) {
+            auto helper = converter_shared_ptr_impl<C>::helper_from_lua(l, n);
+            if (helper.is_error()) {
+                return helper.error();
+            }
+            if (*helper == nullptr) {
+                return converter_error{"attempt to call class method for a nil value"};
+            }
+            auto ptr = (*helper)->template as_ptr<C>();
+            if (ptr.is_error()) {
+                return ptr.error();
+            }
+            if (*ptr == nullptr) {
+                return converter_error{"attempt to call class method for a nil value"};
+            }
+            return detail::method_self<C>(*ptr, *helper);
+        }
+    };
+
     template<class C>
     class class_registrar {
     friend class clg::state_interface;
@@ -48,19 +101,26 @@ namespace clg {
         state_interface& mClg;
 
         class_registrar(state_interface& clg):
-            mClg(clg)
+            mClg(clg),
+            mClassName(clg::class_name<C>())
         {
             // in case of automatic memory management is not able to handle lua_self properly, we provide an
             // additional fallback method to manage memory manually.
             mMethods.push_back(clg::impl::Method{"destroy", cfunction<clg_lua_self_destroy>("clg_destroy")});
         }
 
+        std::string mClassName;
+
         lua_cfunctions mMethods;
         lua_cfunctions mStaticFunctions;
         lua_cfunctions mMetaFunctions;
         std::vector<lua_CFunction> mConstructors;
+        lua_cfunctions mPropertyGetters;
+        lua_cfunctions mPropertySetters;
+        lua_CFunction mBracketsOperator = nullptr;
+        std::vector<void*> mBaseMethodsKeys;
 
-        template<auto methodPtr>
+        template<auto methodPtr, typename Policy = checked>
         struct method_helper {
             using class_info = state_interface::callable_class_info<decltype(methodPtr)>;
 
@@ -68,31 +128,31 @@ namespace clg {
             struct wrapper_function_helper_t {};
             template<typename... Args>
             struct wrapper_function_helper_t<state_interface::types<Args...>> {
-                static typename class_info::return_t method(std::shared_ptr<C> self, Args... args) {
-                    if (!self) {
-                        throw clg_exception("attempt to call class method for a nil value");
-                    }
+                static typename class_info::return_t method(detail::method_self<C> self, Args... args) {
                     if (std::is_same_v<void, typename class_info::return_t>) {
-                        (self.get()->*methodPtr)(std::move(args)...);
+                        (self.ptr->*methodPtr)(std::move(args)...);
                     } else {
-                        return (self.get()->*methodPtr)(std::move(args)...);
+                        return (self.ptr->*methodPtr)(std::move(args)...);
                     }
                 }
-                static clg::builder_return_type builder_method(std::shared_ptr<C> self, Args... args) {
-                    if (!self) {
-                        throw clg_exception("attempt to call class method for a nil value");
-                    }
-                    (self.get()->*methodPtr)(std::move(args)...);
+                static clg::builder_return_type builder_method(detail::method_self<C> self, Args... args) {
+                    (self.ptr->*methodPtr)(std::move(args)...);
                     return {};
                 }
-                using my_instance = typename clg::detail::register_function_helper<typename class_info::return_t, std::shared_ptr<C>, Args...>::template instance<method>;
-                using my_instance_builder = typename clg::detail::register_function_helper<clg::builder_return_type, std::shared_ptr<C>, Args...>::template instance<builder_method>;
+                static typename class_info::return_t method_nothrow(detail::method_self<C> self, Args... args) noexcept {
+                    return (self.ptr->*methodPtr)(std::move(args)...);
+                }
+                using helper = clg::detail::register_function_helper<typename class_info::return_t, detail::method_self<C>, Args...>;
+                using my_instance = std::conditional_t<class_info::is_noexcept && helper::supports_nothrow,
+                                                       typename helper::template nothrow_instance<method_nothrow, Policy>,
+                                                       typename helper::template instance<method, false, Policy>>;
+                using my_instance_builder = typename clg::detail::register_function_helper<clg::builder_return_type, detail::method_self<C>, Args...>::template instance<builder_method>;
             };
 
             using wrapper_function_helper = wrapper_function_helper_t<typename class_info::args>;
         };
 
-        template<auto method>
+        template<auto method, typename Policy = checked>
         struct static_function_helper {
             using class_info = state_interface::callable_class_info<decltype(method)>;
 
@@ -100,14 +160,14 @@ namespace clg {
             struct wrapper_function_helper_t {};
             template<typename... Args>
             struct wrapper_function_helper_t<state_interface::types<Args...>> {
-                static typename class_info::return_t static_method(void* self, Args... args) {
+                static typename class_info::return_t static_method(void* /* self */, Args... args) {
                     if (std::is_same_v<void, typename class_info::return_t>) {
                         method(std::move(args)...);
                     } else {
                         return method(std::move(args)...);
                     }
                 }
-                static typename class_info::return_t static_method_no_this(Args... args) {
+                static typename class_info::return_t static_method_no_this(Args... args) noexcept(class_info::is_noexcept) {
                     if (std::is_same_v<void, typename class_info::return_t>) {
                         method(std::move(args)...);
                     } else {
@@ -115,40 +175,195 @@ namespace clg {
                     }
                 }
                 using my_instance = typename clg::detail::register_function_helper<typename class_info::return_t, void*, Args...>::template instance<static_method>;
-                using my_instance_no_this = typename clg::detail::register_function_helper<typename class_info::return_t, Args...>::template instance<static_method_no_this>;
+                using no_this_helper = clg::detail::register_function_helper<typename class_info::return_t, Args...>;
+                using my_instance_no_this = std::conditional_t<class_info::is_noexcept && no_this_helper::supports_nothrow,
+                                                               typename no_this_helper::template nothrow_instance<static_method_no_this, Policy>,
+                                                               typename no_this_helper::template instance<static_method_no_this, false, Policy>>;
             };
 
             using wrapper_function_helper = wrapper_function_helper_t<typename class_info::args>;
         };
 
-        struct brackets_operator_helper {
-            inline static lua_CFunction func = nullptr;
-            inline static std::optional<clg::ref> methods;
-
-            static int handler(lua_State* L) {
-                clg::impl::raii_state_updater u(L);
-                assert(func != nullptr && methods);
-                if (lua_isstring(L, 2) && !lua_isnumber(L, 2)) {
-                    auto method_name = get_from_lua<std::string_view>(L, 2);
-                    push_to_lua(L, methods->as<table>()[method_name]);
-                    if (!lua_isnil(L, -1)) {
-                        return 1;
+        template<auto field>
+        struct field_helper {
+            using field_t = typename state_interface::member_object<decltype(field)>::type;
+            using value_t = std::remove_cv_t<field_t>;
+
+            static value_t get(detail::method_self<C> self) {
+                return self.ptr->*field;
+            }
+            static value_t get_nothrow(detail::method_self<C> self) noexcept {
+                return self.ptr->*field;
+            }
+            static void set(detail::method_self<C> self, value_t value) {
+                if constexpr (!std::is_const_v<field_t>) {
+                    self.ptr->*field = std::move(value);
+                }
+            }
+            static void set_nothrow(detail::method_self<C> self, value_t value) noexcept {
+                if constexpr (!std::is_const_v<field_t>) {
+                    self.ptr->*field = std::move(value);
+                }
+            }
+
+            using getter_helper = clg::detail::register_function_helper<value_t, detail::method_self<C>>;
+            using getter_instance = std::conditional_t<std::is_nothrow_copy_constructible_v<value_t> && getter_helper::supports_nothrow,
+                                                       typename getter_helper::template nothrow_instance<get_nothrow>,
+                                                       typename getter_helper::template instance<get>>;
+            using setter_helper = clg::detail::register_function_helper<void, detail::method_self<C>, value_t>;
+            using setter_instance = std::conditional_t<std::is_nothrow_move_assignable_v<value_t> && setter_helper::supports_nothrow,
+                                                       typename setter_helper::template nothrow_instance<set_nothrow>,
+                                                       typename setter_helper::template instance<set>>;
+        };
+
+        /**
+         * @brief __index and __newindex of classes which can not use the methods table as __index: classes with
+         * properties, a bracketsOperator or compact_lua_self objects.
+         */
+        struct object_helper {
+            /**
+             * @brief Whether a checked getter or setter returned (nil, message) because the value could not be
+             * converted or the accessor threw. Unlike method calls, property access raises such errors.
+             */
+            static bool is_error_result(lua_State* L, int results) noexcept {
+                return results == 2 && lua_isnil(L, -2) && lua_type(L, -1) == LUA_TSTRING;
+            }
+
+            /**
+             * @brief Looks up property getters, fields added by lua code (compact_lua_self), methods and the
+             * bracketsOperator, in that order. Upvalue 1 is the methods table, upvalue 2 is the property getters table
+             * or nil, upvalue 3 is the bracketsOperator implementation or nil.
+             */
+            static int index(lua_State* L) {
+                // the class table shares the metatable with objects
+                const bool isObject = lua_type(L, 1) == LUA_TUSERDATA;
+                if (isObject && lua_type(L, 2) == LUA_TSTRING && lua_istable(L, lua_upvalueindex(2))) {
+                    lua_pushvalue(L, 2);
+                    lua_rawget(L, lua_upvalueindex(2));
+                    if (auto getter = lua_tocfunction(L, -1)) {
+                        // getters convert self only and leave their arguments on the stack (method_self), so the key
+                        // stays at index 2 and keeps name alive
+                        const char* name = lua_tostring(L, 2);
+                        lua_pop(L, 1);
+                        const int results = getter(L);
+                        if (is_error_result(L, results)) {
+                            return luaL_error(L, "failed to get property '%s': %s", name, lua_tostring(L, -1));
+                        }
+                        return results;
+                    }
+                    lua_pop(L, 1);
+                }
+
+                if constexpr (std::is_base_of_v<clg::compact_lua_self, C>) {
+                    if (isObject) {
+                        if (impl::get_user_value(L, 1) == LUA_TTABLE) {
+                            lua_pushvalue(L, 2);
+                            lua_rawget(L, -2);
+                            if (!lua_isnil(L, -1)) {
+                                return 1;
+                            }
+                            lua_pop(L, 1);
+                        }
+                        lua_pop(L, 1);
                     }
+                }
 
+                if (lua_type(L, 2) == LUA_TSTRING) {
+                    lua_pushvalue(L, 2);
+                    lua_gettable(L, lua_upvalueindex(1));
+                    if (!lua_isnil(L, -1) || lua_isnil(L, lua_upvalueindex(3))) {
+                        return 1;
+                    }
                     lua_pop(L, 1);
+                } else if (lua_isnil(L, lua_upvalueindex(3))) {
+                    lua_pushnil(L);
+                    return 1;
                 }
 
-                lua_pushcfunction(L, func);
+                lua_pushvalue(L, lua_upvalueindex(3));
                 lua_pushvalue(L, 1);
                 lua_pushvalue(L, 2);
                 lua_call(L, 2, 1);
                 return 1;
-            };
+            }
+
+            /**
+             * @brief Calls property setters or, for compact_lua_self, stores fields added by lua code in the user
+             * value of the userdata. Upvalue 1 is the property setters table or nil.
+             */
+            static int newindex(lua_State* L) {
+                if (lua_type(L, 1) != LUA_TUSERDATA) {
+                    lua_settop(L, 3);
+                    lua_rawset(L, 1);
+                    return 0;
+                }
+                if (lua_type(L, 2) == LUA_TSTRING && lua_istable(L, lua_upvalueindex(1))) {
+                    lua_pushvalue(L, 2);
+                    lua_rawget(L, lua_upvalueindex(1));
+                    if (auto setter = lua_tocfunction(L, -1)) {
+                        // the key is kept alive by the caller of __newindex
+                        const char* name = lua_tostring(L, 2);
+                        lua_settop(L, 3);
+                        lua_remove(L, 2);
+                        if (is_error_result(L, setter(L))) {
+                            return luaL_error(L, "failed to set property '%s': %s", name, lua_tostring(L, -1));
+                        }
+                        return 0;
+                    }
+                    lua_pop(L, 1);
+                }
+
+                if constexpr (std::is_base_of_v<clg::compact_lua_self, C>) {
+                    if (impl::get_user_value(L, 1) != LUA_TTABLE) {
+                        lua_pop(L, 1);
+                        lua_newtable(L);
+                        lua_pushvalue(L, -1);
+                        impl::set_user_value(L, 1);
+                    }
+                    lua_pushvalue(L, 2);
+                    lua_pushvalue(L, 3);
+                    lua_rawset(L, -3);
+                    lua_pop(L, 1);
+
+                    if (lua_type(L, 2) != LUA_TSTRING || !lua_isfunction(L, 3)) {
+                        return 0;
+                    }
+                    bool failed = false;
+                    {
+                        clg::impl::raii_state_updater u(L);
+                        try {
+                            auto object = static_cast<shared_ptr_helper*>(lua_touserdata(L, 1))->as_ptr<C>();
+                            if (object.is_error() || *object == nullptr) {
+                                return 0;
+                            }
+                            auto name = get_from_lua<std::string_view>(L, 2);
+                            lua_pushvalue(L, 3);
+                            impl::invoke_handle_lua_virtual_func_assignment(**object, name, clg::ref::from_stack(L));
+                        } catch (const std::exception& e) {
+                            lua_pushstring(L, e.what());
+                            failed = true;
+                        } catch (...) {
+                            lua_pushliteral(L, "unknown exception");
+                            failed = true;
+                        }
+                    }
+                    if (failed) {
+                        // raised after the C++ objects above are destroyed since lua_error does not unwind them
+                        return luaL_error(L, "failed to assign '%s': %s", lua_tostring(L, 2), lua_tostring(L, -1));
+                    }
+                    return 0;
+                } else {
+                    if (lua_type(L, 2) == LUA_TSTRING) {
+                        return luaL_error(L, "no writable property '%s'", lua_tostring(L, 2));
+                    }
+                    return luaL_error(L, "attempt to index a %s object", class_name<C>().c_str());
+                }
+            }
         };
 
         template<typename... Args>
         struct constructor_helper {
-            static std::shared_ptr<C> construct(void* self, Args... args) {
+            static std::shared_ptr<C> construct(void* /* self */, Args... args) {
                 return std::make_shared<C>(std::move(args)...);
             }
         };
@@ -163,6 +378,12 @@ namespace clg {
 
         static int clg_lua_self_destroy(lua_State* l) {
             clg::impl::raii_state_updater u(l);
+            if constexpr (std::is_base_of_v<clg::compact_lua_self, C>) {
+                if (lua_type(l, -1) == LUA_TUSERDATA) {
+                    static_cast<clg::shared_ptr_helper*>(lua_touserdata(l, -1))->release();
+                }
+                return 0;
+            }
             if (!lua_istable(l, -1)) {
                 return 0;
             }
@@ -172,7 +393,7 @@ namespace clg {
                 return 0;
             }
 
-            reinterpret_cast<clg::shared_ptr_helper*>(lua_touserdata(l, -1))->ptr = nullptr;
+            reinterpret_cast<clg::shared_ptr_helper*>(lua_touserdata(l, -1))->release();
 
             return 0;
         }
@@ -206,6 +427,81 @@ namespace clg {
             return 1;
         }
 
+        /**
+         * @brief Makes methods of the base classes declared with bases() available through the methods table.
+         * @details
+         * The methods table gets a metatable whose __index is the methods table of the base, so inherited methods are
+         * shared instead of copied and resolved by lua. With several bases, __index is base_methods_index which tries
+         * them in declaration order.
+         */
+        void link_base_methods(const clg::ref& methods) {
+            if (mBaseMethodsKeys.empty()) {
+                return;
+            }
+            clg::stack_integrity_check check(mClg);
+            methods.push_value_to_stack(mClg);
+            lua_createtable(mClg, 0, 1);
+            for (auto key : mBaseMethodsKeys) {
+                lua_pushlightuserdata(mClg, key);
+                lua_rawget(mClg, LUA_REGISTRYINDEX);
+                assert(lua_istable(mClg, -1) && "checked by bases()");
+            }
+            if (mBaseMethodsKeys.size() > 1) {
+                lua_pushcclosure(mClg, base_methods_index, int(mBaseMethodsKeys.size()));
+            }
+            lua_setfield(mClg, -2, "__index");
+            lua_setmetatable(mClg, -2);
+            lua_pop(mClg, 1);
+        }
+
+        template<typename Base>
+        void check_base_registered() {
+            lua_pushlightuserdata(mClg, detail::class_methods_key<Base>());
+            lua_rawget(mClg, LUA_REGISTRYINDEX);
+            const bool registered = lua_istable(mClg, -1);
+            lua_pop(mClg, 1);
+            if (!registered) {
+                throw clg_exception("base class " + class_name<Base>() + " of " + mClassName +
+                                    " must be registered before the derived class");
+            }
+        }
+
+        void push_table_or_nil(const lua_cfunctions& functions) {
+            if (functions.empty()) {
+                lua_pushnil(mClg);
+                return;
+            }
+            impl::newlib(mClg, functions);
+        }
+
+        /**
+         * @brief __index of methods tables of classes with several bases. Upvalues are the methods tables of the bases.
+         */
+        static int base_methods_index(lua_State* L) {
+            for (int i = 1; lua_istable(L, lua_upvalueindex(i)); ++i) {
+                lua_pushvalue(L, 2);
+                lua_gettable(L, lua_upvalueindex(i));
+                if (!lua_isnil(L, -1)) {
+                    return 1;
+                }
+                lua_pop(L, 1);
+            }
+            lua_pushnil(L);
+            return 1;
+        }
+
+        /**
+         * @brief Name of a binding of this class reported by clg::profiler, i.e. "Class:method" or "Class.static".
+         */
+        std::string trace_name(std::string_view name, char separator) const {
+            std::string result;
+            result.reserve(mClassName.size() + 1 + name.size());
+            result += mClassName;
+            result += separator;
+            result += name;
+            return result;
+        }
+
         static std::string toString(const std::shared_ptr<C>& v) {
             char buf[64];
             std::sprintf(buf, "%s<%p>", class_name<C>().c_str(), v.get());
@@ -214,81 +510,72 @@ namespace clg {
 
     public:
         ~class_registrar() {
-            mClg.class_metainfo();
-
-            std::vector<luaL_Reg> staticFunctions;
+            lua_cfunctions staticFunctions;
             clg::stack_integrity_check check(mClg);
 
-            if constexpr (std::is_base_of_v<clg::allow_lua_inheritance, C>) {
-                if constexpr(!std::is_abstract_v<C>) {
-                    C instance;
-                    for (const auto& e: mClg.class_metainfo()) {
-                        if (e.isBaseOf(&instance)) {
-                            for (const auto& method : e.methods) {
-                                auto it = std::find_if(mMethods.begin(), mMethods.end(), [&](const auto& v) {
-                                    return v.name == method.name;
-                                });
-                                if (it == mMethods.end()) {
-                                    mMethods.push_back(method);
-                                } else {
-                                    *it = method;
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-
+            staticFunctions.reserve(mConstructors.size() + mStaticFunctions.size());
             for (auto& c : mConstructors) {
                 staticFunctions.push_back({"new", c});
             }
             for (auto& c : mStaticFunctions) {
-                staticFunctions.push_back({c.name.c_str(), c.cFunction});
+                staticFunctions.push_back(std::move(c));
             }
 
-            staticFunctions.push_back({nullptr, nullptr});
-
-            const auto classname = clg::class_name<C>();
+            const auto& classname = mClassName;
 
             auto clazz = impl::table_from_c_functions(mClg, staticFunctions);
 
-            std::vector<luaL_Reg> metatableFunctions = {
+            lua_cfunctions metatableFunctions = {
                     { "__gc", gc },
                     { "__eq", eq },
                     { "__concat", concat },
                     { "__tostring", tostring },
             };
-            metatableFunctions.reserve(metatableFunctions.size() + mMetaFunctions.size() + 1);
-            for (const auto& v : mMetaFunctions) {
-                metatableFunctions.push_back({v.name.c_str(), v.cFunction});
+            metatableFunctions.reserve(metatableFunctions.size() + mMetaFunctions.size());
+            for (auto& v : mMetaFunctions) {
+                metatableFunctions.push_back(std::move(v));
             }
 
-            metatableFunctions.push_back({nullptr});
-
             clg::table_view metatable = impl::table_from_c_functions(mClg, metatableFunctions);
 
             auto methods = impl::table_from_c_functions(mClg, mMethods);
-
-            if (brackets_operator_helper::func) {
-                metatable["__index"] = static_cast<lua_CFunction>(brackets_operator_helper::handler);
-                brackets_operator_helper::methods = std::move(methods);
+            link_base_methods(methods);
+
+            // derived classes look up inherited methods in this table (see link_base_methods)
+            lua_pushlightuserdata(mClg, detail::class_methods_key<C>());
+            methods.push_value_to_stack(mClg);
+            lua_rawset(mClg, LUA_REGISTRYINDEX);
+
+            constexpr bool isCompact = std::is_base_of_v<clg::compact_lua_self, C>;
+            const bool hasProperties = !mPropertyGetters.empty() || !mPropertySetters.empty();
+            if (isCompact || hasProperties || mBracketsOperator) {
+                methods.push_value_to_stack(mClg);
+                push_table_or_nil(mPropertyGetters);
+                if (mBracketsOperator) {
+                    lua_pushcfunction(mClg, mBracketsOperator);
+                } else {
+                    lua_pushnil(mClg);
+                }
+                lua_pushcclosure(mClg, object_helper::index, 3);
+                metatable["__index"] = clg::ref::from_stack(mClg);
             }
             else {
                 metatable["__index"] = methods;
             }
+            if (isCompact || hasProperties) {
+                push_table_or_nil(mPropertySetters);
+                lua_pushcclosure(mClg, object_helper::newindex, 1);
+                metatable["__newindex"] = clg::ref::from_stack(mClg);
+            }
 
             clazz.set_metatable(metatable);
 
-            mClg.set_global_value(classname, clazz);
+            // objects of the class are pushed with this metatable (see converter_shared_ptr_impl::set_class_metatable)
+            lua_pushlightuserdata(mClg, detail::class_metatable_key<C>());
+            metatable.push_value_to_stack(mClg);
+            lua_rawset(mClg, LUA_REGISTRYINDEX);
 
-            if constexpr (std::is_base_of_v<clg::allow_lua_inheritance, C>) {
-                mClg.class_metainfo().push_back({
-                    [](clg::allow_lua_inheritance* probe) {
-                        return dynamic_cast<clg::allow_lua_inheritance*>(probe) != nullptr;
-                    },
-                    std::move(mMethods)
-                });
-            }
+            mClg.set_global_value(classname, clazz);
         }
 
 
@@ -296,6 +583,7 @@ namespace clg {
         class_registrar<C>& constructor() noexcept {
             using my_register_function_helper = clg::detail::register_function_helper<std::shared_ptr<C>, void*, Args...>;
             using my_instance = typename my_register_function_helper::template instance<constructor_helper<Args...>::construct>;
+            my_instance::set_trace_name(trace_name("new", '.'));
 
             mConstructors.push_back({
                 my_instance::call
@@ -303,13 +591,14 @@ namespace clg {
             return *this;
         }
 
-        template<auto m>
+        /**
+         * @tparam Policy clg::checked (default) or clg::unchecked for methods called by trusted scripts only
+         */
+        template<auto m, typename Policy = checked>
         class_registrar<C>& method(std::string name) {
-            using wrapper_function_helper = typename method_helper<m>::wrapper_function_helper;
+            using wrapper_function_helper = typename method_helper<m, Policy>::wrapper_function_helper;
             using my_instance = typename wrapper_function_helper::my_instance;
-#if CLG_TRACE_CALLS
-            my_instance::trace_name() = name;
-#endif
+            my_instance::set_trace_name(trace_name(name, ':'));
             mMethods.push_back({
                std::move(name),
                my_instance::call
@@ -318,10 +607,11 @@ namespace clg {
         }
         template<typename Callable>
         class_registrar<C>& method(std::string name, Callable&& callable) {
-            auto v = mClg.wrap_lambda_to_cfunction(std::forward<Callable>(callable), name);
+            auto v = mClg.wrap_lambda_to_cfunction(std::forward<Callable>(callable), trace_name(name, ':'));
             mMethods.push_back({
                std::move(name),
-               v
+               v.function,
+               std::move(v.upvalue)
             });
             return *this;
         }
@@ -330,9 +620,7 @@ namespace clg {
         class_registrar<C>& builder_method(std::string name) {
             using wrapper_function_helper = typename method_helper<m>::wrapper_function_helper;
             using my_instance = typename wrapper_function_helper::my_instance_builder;
-#if CLG_TRACE_CALLS
-            my_instance::trace_name() = name;
-#endif
+            my_instance::set_trace_name(trace_name(name, ':'));
             mMethods.push_back({
                std::move(name),
                my_instance::call
@@ -340,15 +628,16 @@ namespace clg {
             return *this;
         }
 
-        template<auto m>
+        /**
+         * @tparam Policy clg::checked (default) or clg::unchecked for functions called by trusted scripts only
+         */
+        template<auto m, typename Policy = checked>
         class_registrar<C>& staticFunction(std::string name) {
-            using wrapper_function_helper = typename static_function_helper<m>::wrapper_function_helper;
+            using wrapper_function_helper = typename static_function_helper<m, Policy>::wrapper_function_helper;
 
             using my_instance = typename wrapper_function_helper::my_instance_no_this;
 
-#if CLG_TRACE_CALLS
-            my_instance::trace_name() = name;
-#endif
+            my_instance::set_trace_name(trace_name(name, '.'));
 
             constexpr auto call = my_instance::call;
             mStaticFunctions.push_back({
@@ -360,22 +649,24 @@ namespace clg {
 
         template<typename Callable>
         class_registrar<C>& staticFunction(std::string name, Callable&& callback) {
-            auto wrap = mClg.wrap_lambda_to_cfunction(std::forward<Callable>(callback), name);
+            auto wrap = mClg.wrap_lambda_to_cfunction(std::forward<Callable>(callback), trace_name(name, '.'));
 
             mStaticFunctions.push_back({
                std::move(name),
-               wrap
+               wrap.function,
+               std::move(wrap.upvalue)
             });
             return *this;
         }
 
         template<typename Callable>
         class_registrar<C>& meta(std::string name, Callable&& callback) {
-            auto wrap = mClg.wrap_lambda_to_cfunction(std::forward<Callable>(callback), name);
+            auto wrap = mClg.wrap_lambda_to_cfunction(std::forward<Callable>(callback), trace_name(name, '.'));
 
             mMetaFunctions.push_back({
                                                std::move(name),
-                                               wrap
+                                               wrap.function,
+                                               std::move(wrap.upvalue)
                                        });
             return *this;
         }
@@ -386,9 +677,7 @@ namespace clg {
 
             using my_instance = typename wrapper_function_helper::my_instance_no_this;
 
-#if CLG_TRACE_CALLS
-            my_instance::trace_name() = name;
-#endif
+            my_instance::set_trace_name(trace_name(name, '.'));
 
             constexpr auto call = my_instance::call;
             mMetaFunctions.push_back({
@@ -398,11 +687,68 @@ namespace clg {
             return *this;
         }
 
+        /**
+         * @brief Binds a property accessed from lua as obj.name and assigned as obj.name = value.
+         * @tparam getter pointer to a data member (read-only if const) or a getter method
+         * @tparam setter setter method or nullptr for a read-only property; must be nullptr for data members
+         * @details
+         * @code{cpp}
+         * vm.register_class<Entity>()
+         *   .property<&Entity::hp>("hp")
+         *   .property<&Entity::name, &Entity::setName>("name");
+         * @endcode
+         * Properties are looked up before methods. Not supported by lua_self: its objects are tables whose lookups
+         * reach the class metatable through the data holder with a weak userdata as self; use compact_lua_self instead.
+         */
+        template<auto getter, auto setter = nullptr>
+        class_registrar<C>& property(std::string name) {
+            static_assert(!std::is_base_of_v<clg::lua_self, C>, "properties are not supported by lua_self objects; use clg::compact_lua_self");
+            if constexpr (std::is_member_object_pointer_v<decltype(getter)>) {
+                static_assert(std::is_null_pointer_v<decltype(setter)>, "data member properties do not take a setter");
+                using helper = field_helper<getter>;
+                helper::getter_instance::set_trace_name(trace_name(name, '.'));
+                if constexpr (!std::is_const_v<typename helper::field_t>) {
+                    helper::setter_instance::set_trace_name(trace_name(name, '.'));
+                    mPropertySetters.push_back({ name, helper::setter_instance::call });
+                }
+                mPropertyGetters.push_back({ std::move(name), helper::getter_instance::call });
+            } else {
+                using getter_instance = typename method_helper<getter>::wrapper_function_helper::my_instance;
+                getter_instance::set_trace_name(trace_name(name, '.'));
+                if constexpr (!std::is_null_pointer_v<decltype(setter)>) {
+                    using setter_instance = typename method_helper<setter>::wrapper_function_helper::my_instance;
+                    setter_instance::set_trace_name(trace_name(name, '.'));
+                    mPropertySetters.push_back({ name, setter_instance::call });
+                }
+                mPropertyGetters.push_back({ std::move(name), getter_instance::call });
+            }
+            return *this;
+        }
+
+        /**
+         * @brief Declares base classes of C: objects of C convert to them without RTTI lookups and inherit their methods.
+         * @details
+         * The bases must be registered before C. List every base objects are passed to C++ as, including indirect
+         * ones:
+         * @code{cpp}
+         * vm.register_class<Dog>().bases<Animal, Object>();
+         * @endcode
+         * @throws clg_exception if a base is not registered in this state yet
+         */
+        template<typename... Bases>
+        class_registrar<C>& bases() {
+            (check_base_registered<std::remove_cv_t<Bases>>(), ...);
+            (detail::derived_casts<Bases>::template add<C>(), ...);
+            (mBaseMethodsKeys.push_back(detail::class_methods_key<std::remove_cv_t<Bases>>()), ...);
+            return *this;
+        }
+
         template<auto m>
         class_registrar<C>& bracketsOperator() {
             using wrapper_function_helper = typename method_helper<m>::wrapper_function_helper;
             using my_instance = typename wrapper_function_helper::my_instance;
-            brackets_operator_helper::func = my_instance::call;
+            my_instance::set_trace_name(trace_name("__index", '.'));
+            mBracketsOperator = my_instance::call;
             return *this;
         }
 
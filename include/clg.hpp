@@ -4,8 +4,6 @@
 
 #pragma once
 
-#define CLG_TRACE_CALLS 0
-
 #include "lua.hpp"
 #include "converter.hpp"
 #include "dynamic_result.hpp"
@@ -14,29 +12,71 @@
 #include "vararg.hpp"
 #include "shared_ptr_helper.hpp"
 #include "magic_enum.hpp"
+#include "profiler.hpp"
+#include "sampling_profiler.hpp"
+#include "bytecode_cache.hpp"
+#include "embedded.hpp"
 
+#include <array>
+#include <algorithm>
 #include <cstring>
+#include <fstream>
+#include <iterator>
+#include <list>
+#include <memory>
 #include <thread>
 #include <sstream>
+#include <unordered_map>
 #include "cfunction.hpp"
 
 namespace clg {
     template<class C>
     class class_registrar;
 
+    /**
+     * @brief lua_CFunction with an optional upvalue (i.e. a lambda stored in a userdata, see push_callable_userdata).
+     */
+    struct cclosure {
+        lua_CFunction function;
+        clg::ref upvalue;
+
+        void push(lua_State* L) const;
+    };
+
     namespace impl {
+        inline void push_cfunction(lua_State* L, lua_CFunction function, const clg::ref& upvalue) {
+            if (upvalue.isNull()) {
+                lua_pushcfunction(L, function);
+            } else {
+                upvalue.push_value_to_stack(L);
+                lua_pushcclosure(L, function, 1);
+            }
+        }
+
         struct Method {
             std::string name;
             lua_CFunction cFunction;
+
+            /**
+             * @brief When not null, cFunction is pushed as a C closure with this value as its only upvalue.
+             */
+            clg::ref upvalue;
+
+            Method(std::string name, lua_CFunction cFunction, clg::ref upvalue = nullptr):
+                name(std::move(name)),
+                cFunction(cFunction),
+                upvalue(std::move(upvalue)) {}
+
+            void push(lua_State* L) const {
+                push_cfunction(L, cFunction, upvalue);
+            }
         };
     }
-    using lua_cfunctions = std::vector<impl::Method>;
-
 
-    struct class_inherit_metainfo {
-        std::function<bool(clg::allow_lua_inheritance* child)> isBaseOf;
-        lua_cfunctions methods;
-    };
+    inline void cclosure::push(lua_State* L) const {
+        impl::push_cfunction(L, function, upvalue);
+    }
+    using lua_cfunctions = std::vector<impl::Method>;
 
 
     /**
@@ -45,7 +85,7 @@ namespace clg {
     class state_interface {
     private:
         lua_State* mState;
-        std::thread::id mMyThread = std::this_thread::get_id();
+        impl::state_owner mOwner;
 
         void throw_syntax_error() {
             auto s = pop_from_lua<std::string>(mState);
@@ -57,15 +97,106 @@ namespace clg {
         }
 
 
-        std::vector<class_inherit_metainfo> mClassMetainfo;
+        std::unique_ptr<sampling_profiler> mSamplingProfiler;
+        std::shared_ptr<clg::bytecode_cache> mBytecodeCache;
+        bool mBytecodeCacheStrings = false;
 
-    public:
+        struct cached_chunk {
+            std::string source;
+            int ref;
+        };
 
+        /**
+         * @brief Compiled do_string snippets, most recently used first.
+         */
+        std::list<cached_chunk> mChunkCache;
+        std::unordered_map<std::string_view, std::list<cached_chunk>::iterator> mChunkCacheIndex;
+        std::size_t mChunkCacheCapacity = 0;
+
+        /**
+         * @brief luaL_loadstring through the bytecode cache.
+         */
+        int load_string(const std::string& source) {
+            if (mBytecodeCache && mBytecodeCacheStrings) {
+                return mBytecodeCache->load(mState, source, source.c_str());
+            }
+            return luaL_loadbuffer(mState, source.data(), source.size(), source.c_str());
+        }
+
+        void evict_last_chunk() {
+            auto& last = mChunkCache.back();
+            luaL_unref(mState, LUA_REGISTRYINDEX, last.ref);
+            mChunkCacheIndex.erase(last.source);
+            mChunkCache.pop_back();
+        }
+
+        /**
+         * @brief Pushes the compiled snippet, compiling it on a chunk cache miss.
+         */
+        int load_string_cached(const std::string& source) {
+            if (auto it = mChunkCacheIndex.find(source); it != mChunkCacheIndex.end()) {
+                mChunkCache.splice(mChunkCache.begin(), mChunkCache, it->second);
+                lua_rawgeti(mState, LUA_REGISTRYINDEX, it->second->ref);
+                return LUA_OK;
+            }
+            if (auto status = load_string(source); status != LUA_OK) {
+                return status;
+            }
+            if (mChunkCache.size() >= mChunkCacheCapacity) {
+                evict_last_chunk();
+            }
+            lua_pushvalue(mState, -1);
+            auto& entry = mChunkCache.emplace_front(cached_chunk{ source, luaL_ref(mState, LUA_REGISTRYINDEX) });
+            mChunkCacheIndex.emplace(entry.source, mChunkCache.begin());
+            return LUA_OK;
+        }
+
+        static int load_embedded_chunk(lua_State* L, const embedded_chunk& chunk) {
+            std::string chunkName = "=" + std::string(chunk.name);
+            return luaL_loadbufferx(L, reinterpret_cast<const char*>(chunk.bytecode), chunk.size, chunkName.c_str(), "b");
+        }
+
+        static int embedded_searcher(lua_State* L) {
+            const char* name = luaL_checkstring(L, 1);
+            auto chunk = find_embedded_chunk(name);
+            if (!chunk) {
+#if LUA_VERSION_NUM == 501
+                lua_pushfstring(L, "\n\tno embedded chunk '%s'", name);
+#else
+                lua_pushfstring(L, "no embedded chunk '%s'", name);
+#endif
+                return 1;
+            }
+            if (load_embedded_chunk(L, *chunk) != LUA_OK) {
+                return luaL_error(L, "error loading embedded module '%s':\n\t%s", name, lua_tostring(L, -1));
+            }
+            lua_pushfstring(L, ":embedded:%s", name);
+            return 2;
+        }
 
-        std::vector<class_inherit_metainfo>& class_metainfo() {
-            return mClassMetainfo;
+        /**
+         * @brief luaL_loadfile through the bytecode cache.
+         */
+        int load_file_cached(const std::string& path) {
+            std::ifstream fis(path, std::ios::binary);
+            if (!fis) {
+                return luaL_loadfile(mState, path.c_str()); // produces the usual "cannot open" message
+            }
+            std::string source((std::istreambuf_iterator<char>(fis)), std::istreambuf_iterator<char>());
+            if (!source.empty() && source.front() == LUA_SIGNATURE[0]) {
+                return luaL_loadfile(mState, path.c_str()); // precompiled chunk
+            }
+            std::string_view code = source;
+            if (!code.empty() && code.front() == '#') {
+                // skip the unix exec line like luaL_loadfile does, keeping the newline to preserve line numbers
+                auto newline = code.find('\n');
+                code.remove_prefix(newline == std::string_view::npos ? code.size() : newline);
+            }
+            return mBytecodeCache->load(mState, code, ("@" + path).c_str());
         }
 
+    public:
+
 
         template<class...>
         struct types {
@@ -113,66 +244,142 @@ namespace clg {
         struct callable_class_info<R(*)(Args...)> {
             using args = types<Args...>;
             using return_t = R;
+            static constexpr bool is_noexcept = false;
         };
+        template<typename R, typename... Args>
+        struct callable_class_info<R(*)(Args...) noexcept> {
+            using args = types<Args...>;
+            using return_t = R;
+            static constexpr bool is_noexcept = true;
+        };
+
+        template<typename MemberPtr>
+        struct member_object;
 
+        template<typename Class, typename T>
+        struct member_object<T Class::*> {
+            using class_t = Class;
+            using type = T;
+        };
+
+        /**
+         * @brief Generates lua_CFunctions for a lambda. The lambda itself is stored in the first upvalue of the C
+         * closure, so each registration (and each state) owns its own copy.
+         */
         template<typename Callable>
         struct callable_helper {
             using function_info = callable_class_info<decltype(&Callable::operator())>;
 
             template<typename... Args>
-            struct wrapper_function_helper_t {};
+            struct register_helper_t {};
             template<typename... Args>
-            struct wrapper_function_helper_t<types<Args...>> {
-                static typename function_info::return_t wrapper_function(Args... args) {
-                    if (std::is_same_v<typename function_info::return_t, void>) {
-                        (*callable())(std::move(args)...);
-                    } else {
-                        return (*callable())(std::move(args)...);
-                    }
-                }
+            struct register_helper_t<types<Args...>> {
+                using type = clg::detail::register_function_helper<typename function_info::return_t, Args...>;
             };
 
-            using wrapper_function_helper = wrapper_function_helper_t<typename function_info::args>;
-
-            static Callable*& callable() {
-                static Callable* callable = nullptr;
-                return callable;
-            }
+            using register_helper = typename register_helper_t<typename function_info::args>::type;
 
+            template<bool passthroughSubstitutionError = false, typename Policy = checked>
+            using instance = std::conditional_t<function_info::is_noexcept && register_helper::supports_nothrow && !passthroughSubstitutionError,
+                                                typename register_helper::template nothrow_closure_instance<Callable, Policy>,
+                                                typename register_helper::template closure_instance<Callable, passthroughSubstitutionError, Policy>>;
         };
 
 
+        /**
+         * @brief Argument count and accepted lua types of each argument of a Callable, used to pick an overload
+         * without converting arguments.
+         */
+        template<typename Args>
+        struct overload_signature;
+
+        template<typename... Args>
+        struct overload_signature<types<Args...>> {
+            static constexpr bool is_vararg = std::is_same_v<std::tuple<std::decay_t<Args>...>, std::tuple<vararg>>;
+            static constexpr int argc = (0 + ... + int(!std::is_same_v<lua_State*, std::decay_t<Args>>));
+
+            static constexpr std::array<lua_type_mask, argc> masks = [] {
+                std::array<lua_type_mask, argc> result{};
+                std::size_t i = 0;
+                ((std::is_same_v<lua_State*, std::decay_t<Args>> ? void() : void(result[i++] = converter_lua_types<Args>)), ...);
+                return result;
+            }();
+
+            /**
+             * @param types lua_type of the first min(argCount, argc) arguments
+             */
+            static bool accepts(const int* types, int argCount) noexcept {
+                if constexpr (is_vararg) {
+                    return true;
+                } else {
+                    if (argCount != argc) {
+                        return false;
+                    }
+                    for (int i = 0; i < argc; ++i) {
+                        if (!(masks[i] & lua_type_bit(types[i]))) {
+                            return false;
+                        }
+                    }
+                    return true;
+                }
+            }
+        };
+
         template<typename... Callables>
         struct overloaded_helper {
+            using storage = std::tuple<Callables...>;
+
+            template<typename Callable>
+            using signature = overload_signature<typename callable_class_info<decltype(&Callable::operator())>::args>;
+
+            static constexpr int max_argc = std::max({ 1, signature<Callables>::argc... });
+
             static int fake_lua_cfunction(lua_State* L) noexcept {
-                std::string errorDescription;
-                auto stack = lua_gettop(L);
-                for (const auto& func : callable()) {
-                    try {
-                        auto r = func(L);
-                        if (r != OVERLOADED_HELPER_SUBSTITUTION_FAILURE) {
-                            return r;
-                        }
-                    } catch (const clg::substitution_error& e) {
-                        if (!errorDescription.empty()) {
-                            errorDescription += "; ";
-                        }
-                        errorDescription += e.what();
+                int argCount = lua_gettop(L);
+                int types[max_argc];
+                {
+                    profiler::call_scope profile(profiler::enabled() ? binding().load(std::memory_order_relaxed) : nullptr);
+                    auto& callables = *static_cast<storage*>(lua_touserdata(L, lua_upvalueindex(1)));
+                    for (int i = 0, count = std::min(argCount, max_argc); i < count; ++i) {
+                        types[i] = lua_type(L, i + 1);
+                    }
+                    auto r = try_overloads(L, callables, types, argCount, std::index_sequence_for<Callables...>{});
+                    if (r != OVERLOADED_HELPER_SUBSTITUTION_FAILURE) {
+                        return r;
                     }
-                    assert(lua_gettop(L) == stack);
                 }
-                luaL_error(L, "overloaded function substitution error: %s", errorDescription.c_str());
-                return 0;
+                // the message is assembled on the lua stack: lua_error does not unwind C++ objects
+                luaL_where(L, 1);
+                lua_pushstring(L, "overloaded function substitution error: no overload accepts (");
+                lua_concat(L, 2);
+                for (int i = 1; i <= argCount; ++i) {
+                    lua_pushstring(L, luaL_typename(L, i));
+                    lua_pushstring(L, i == argCount ? "" : ", ");
+                    lua_concat(L, 3);
+                }
+                lua_pushstring(L, ")");
+                lua_concat(L, 2);
+                return lua_error(L);
+            }
+
+            static std::atomic<profiler::binding_stats*>& binding() noexcept {
+                static std::atomic<profiler::binding_stats*> v = nullptr;
+                return v;
             }
 
-            static std::vector<lua_CFunction>& callable() {
-                static std::vector<lua_CFunction> callable;
-                return callable;
+        private:
+            template<std::size_t... I>
+            static int try_overloads(lua_State* L, storage& callables, const int* types, int argCount, std::index_sequence<I...>) {
+                int r = OVERLOADED_HELPER_SUBSTITUTION_FAILURE;
+                // the first overload whose signature matches the argument types and which converts them wins
+                ((signature<Callables>::accepts(types, argCount) &&
+                  (r = callable_helper<Callables>::register_helper::template invoke<true>(L, std::get<I>(callables))) != OVERLOADED_HELPER_SUBSTITUTION_FAILURE) || ...);
+                return r;
             }
         };
 
         state_interface(lua_State* state) : mState(state) {
-
+            impl::set_owner(mState, &mOwner);
         }
 
         void init_global_functions();
@@ -183,54 +390,113 @@ namespace clg {
             return class_registrar<C>(*this);
         }
 
-        template<auto f>
+        /**
+         * @tparam Policy clg::checked (default) or clg::unchecked for functions called by trusted scripts only
+         */
+        template<auto f, typename Policy = checked>
         void register_function(const std::string& name) {
-            register_function_raw(name, cfunction<f>(name));
+            register_function_raw(name, cfunction<f, Policy>(name));
         }
 
-        template<typename Callable>
+        /**
+         * @tparam Policy clg::checked (default) or clg::unchecked, i.e. register_function<clg::unchecked>(name, lambda)
+         */
+        template<typename Policy = checked, typename Callable>
         void register_function(const std::string& name, Callable callable) {
-            using helper = callable_helper<Callable>;
-            helper::callable() = new Callable(std::move(callable));
-            register_function<helper::wrapper_function_helper::wrapper_function>(name);
+            static_assert(detail::is_binding_policy<Policy>, "Policy is expected to be clg::checked or clg::unchecked");
+            using my_instance = typename callable_helper<Callable>::template instance<false, Policy>;
+            my_instance::set_trace_name(name);
+            push_callable_userdata(mState, std::move(callable));
+            lua_pushcclosure(mState, my_instance::call, 1);
+            lua_setglobal(mState, name.c_str());
         }
 
         template<typename FirstCallable, typename... RestCallables>
-        std::vector<lua_CFunction>& register_function_overloaded(const std::string& name, FirstCallable&& firstCallable, RestCallables&&... restCallables) {
-            using helper = overloaded_helper<FirstCallable, RestCallables...>;
-            auto& callable = helper::callable();
-            callable = { wrap_lambda_to_cfunction_for_overloading(std::forward<FirstCallable>(firstCallable), name),
-                         wrap_lambda_to_cfunction_for_overloading(std::forward<RestCallables>(restCallables), name)...  };
-            register_function_raw(name, helper::fake_lua_cfunction);
-            return helper::callable();
+        void register_function_overloaded(const std::string& name, FirstCallable&& firstCallable, RestCallables&&... restCallables) {
+            using helper = overloaded_helper<std::decay_t<FirstCallable>, std::decay_t<RestCallables>...>;
+            if (helper::binding().load() == nullptr) {
+                auto& stats = profiler::binding(name, profiler::direction::lua_to_cpp);
+                helper::binding() = &stats;
+                profiler::name_function(helper::fake_lua_cfunction, stats);
+            }
+            push_callable_userdata(mState, typename helper::storage(std::forward<FirstCallable>(firstCallable),
+                                                                    std::forward<RestCallables>(restCallables)...));
+            lua_pushcclosure(mState, helper::fake_lua_cfunction, 1);
+            lua_setglobal(mState, name.c_str());
         }
 
 
-        template<typename Callable, bool passthroughSubstitutionError = false>
-        lua_CFunction wrap_lambda_to_cfunction(Callable&& callable, const std::string& name) {
-            using helper = callable_helper<Callable>;
-            constexpr auto f = helper::wrapper_function_helper::wrapper_function;
-            using my_register_function_helper = decltype(clg::detail::make_register_function_helper(f));
-            using my_instance = typename my_register_function_helper::template instance<f, passthroughSubstitutionError>;
+        /**
+         * @brief Wraps a lambda to a C closure owning a copy of the lambda.
+         */
+        template<typename Callable>
+        cclosure wrap_lambda_to_cfunction(Callable&& callable, const std::string& name) {
+            using my_instance = typename callable_helper<std::decay_t<Callable>>::template instance<>;
+            my_instance::set_trace_name(name);
+            push_callable_userdata(mState, std::forward<Callable>(callable));
+            return { my_instance::call, clg::ref::from_stack(mState) };
+        }
 
-#if CLG_TRACE_CALLS
-            my_instance::trace_name() = name;
-#endif
+        /**
+         * @brief Makes do_file (and optionally do_string) load compiled chunks from the cache instead of parsing the
+         * source each time. The cache may be shared between states. nullptr disables caching.
+         * @param cacheStrings also cache do_string snippets. Every distinct snippet becomes a cache entry (and a file
+         * if the cache has a directory), so enable it only if the set of snippets is fixed.
+         */
+        void set_bytecode_cache(std::shared_ptr<clg::bytecode_cache> cache, bool cacheStrings = false) noexcept {
+            mBytecodeCache = std::move(cache);
+            mBytecodeCacheStrings = cacheStrings;
+        }
 
-            delete helper::callable();
-            helper::callable() = new Callable(std::forward<Callable>(callable));
+        [[nodiscard]]
+        const std::shared_ptr<clg::bytecode_cache>& bytecode_cache() const noexcept {
+            return mBytecodeCache;
+        }
+
+        /**
+         * @brief Keeps up to capacity compiled do_string snippets (least recently used are evicted), so executing the
+         * same snippet again only costs lua_pcall. 0 (default) disables the cache.
+         */
+        void set_chunk_cache_capacity(std::size_t capacity) {
+            mChunkCacheCapacity = capacity;
+            while (mChunkCache.size() > mChunkCacheCapacity) {
+                evict_last_chunk();
+            }
+        }
 
-            return my_instance::call;
+        [[nodiscard]]
+        std::size_t chunk_cache_capacity() const noexcept {
+            return mChunkCacheCapacity;
         }
 
-        template<typename Callable>
-        lua_CFunction wrap_lambda_to_cfunction_for_overloading(Callable&& callable, const std::string& traceName) { // used only for register_function_overloaded
-            return wrap_lambda_to_cfunction<Callable, true>(std::forward<Callable>(callable), traceName);
+        /**
+         * @brief Compiles a snippet once; pass the result to do_string to run it.
+         */
+        clg::function compile(const std::string& exec) {
+            if (load_string(exec) != LUA_OK) {
+                throw_syntax_error();
+            }
+            return clg::function(clg::ref::from_stack(mState));
         }
 
         template<typename ReturnType = void>
         ReturnType do_string(const std::string& exec) {
-            if (luaL_dostring(mState, exec.c_str()) != 0) {
+            const auto status = mChunkCacheCapacity > 0 ? load_string_cached(exec) : load_string(exec);
+            if (status != LUA_OK || lua_pcall(mState, 0, LUA_MULTRET, 0) != LUA_OK) {
+                throw_syntax_error();
+            }
+            if constexpr (!std::is_same_v<void, ReturnType>) {
+                return get_from_lua<ReturnType>(mState);
+            }
+        }
+
+        /**
+         * @brief Runs a snippet compiled by compile().
+         */
+        template<typename ReturnType = void>
+        ReturnType do_string(const clg::function& chunk) {
+            chunk.mRef.push_value_to_stack(mState);
+            if (lua_pcall(mState, 0, LUA_MULTRET, 0) != LUA_OK) {
                 throw_syntax_error();
             }
             if constexpr (!std::is_same_v<void, ReturnType>) {
@@ -239,7 +505,11 @@ namespace clg {
         }
         template<typename ReturnType = void>
         ReturnType do_file(const std::string& exec) {
-            if (luaL_dofile(mState, exec.c_str()) != 0) {
+            if (mBytecodeCache) {
+                if (load_file_cached(exec) != LUA_OK || lua_pcall(mState, 0, LUA_MULTRET, 0) != LUA_OK) {
+                    throw_syntax_error();
+                }
+            } else if (luaL_dofile(mState, exec.c_str()) != 0) {
                 throw_syntax_error();
             }
             if constexpr (!std::is_same_v<void, ReturnType>) {
@@ -247,11 +517,68 @@ namespace clg {
             }
         }
 
+        /**
+         * @brief Pushes a chunk embedded by clg_embed_scripts() as a function.
+         * @throws clg::lua_exception if there is no such chunk.
+         */
+        void load_embedded(std::string_view name) {
+            auto chunk = find_embedded_chunk(name);
+            if (!chunk) {
+                throw lua_exception("no embedded chunk '" + std::string(name) + "'");
+            }
+            if (load_embedded_chunk(mState, *chunk) != LUA_OK) {
+                throw_syntax_error();
+            }
+        }
+
+        /**
+         * @brief Runs a chunk embedded by clg_embed_scripts().
+         */
+        template<typename ReturnType = void>
+        ReturnType do_embedded(std::string_view name) {
+            load_embedded(name);
+            if (lua_pcall(mState, 0, LUA_MULTRET, 0) != LUA_OK) {
+                throw_syntax_error();
+            }
+            if constexpr (!std::is_same_v<void, ReturnType>) {
+                return get_from_lua<ReturnType>(mState);
+            }
+        }
+
+        /**
+         * @brief Makes require find chunks embedded by clg_embed_scripts(). The embedded chunks are searched right
+         * after package.preload, before the filesystem.
+         */
+        void enable_embedded_require() {
+            lua_getglobal(mState, "package");
+            lua_getfield(mState, -1, CLG_LUA_SEARCHERS);
+            if (!lua_istable(mState, -1)) {
+                lua_pop(mState, 2);
+                throw lua_exception("package." CLG_LUA_SEARCHERS " is not available");
+            }
+            // table.insert(package.searchers, 2, embedded_searcher)
+            for (auto i = lua_Integer(lua_rawlen(mState, -1)); i >= 2; --i) {
+                lua_rawgeti(mState, -1, i);
+                lua_rawseti(mState, -2, i + 1);
+            }
+            lua_pushcfunction(mState, embedded_searcher);
+            lua_rawseti(mState, -2, 2);
+            lua_pop(mState, 2);
+        }
+
         operator lua_State*() const {
-            assert(("multithreading is not supported", mMyThread == std::this_thread::get_id()));
+            assert(mOwner.thread.load(std::memory_order_relaxed) == std::this_thread::get_id() && "multithreading is not supported");
             return mState;
         }
 
+        /**
+         * @brief Hands the state over to the calling thread. The previous thread must not use the state afterwards.
+         * @note The caller is responsible for binding the state to the thread (clg::impl::raii_state_updater).
+         */
+        void bind_to_current_thread() noexcept {
+            mOwner.thread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+        }
+
         template<typename Enum>
         static int to_int_mapper(Enum value) {
             return static_cast<int>(value);
@@ -304,6 +631,42 @@ namespace clg {
         void collectGarbage() {
             lua_gc(mState, LUA_GCCOLLECT, 0);
         }
+
+        /**
+         * @brief Starts sampling the Lua call stack every instructionInterval Lua instructions.
+         * @details
+         * Samples accumulate until reset_sampling(); restarting with a different interval keeps collected samples.
+         * @see clg::sampling_profiler
+         */
+        void start_sampling(int instructionInterval = 1000) {
+            if (!mSamplingProfiler) {
+                mSamplingProfiler = std::make_unique<sampling_profiler>(mState);
+            }
+            mSamplingProfiler->start(instructionInterval);
+        }
+
+        void stop_sampling() noexcept {
+            if (mSamplingProfiler) {
+                mSamplingProfiler->stop();
+            }
+        }
+
+        void reset_sampling() noexcept {
+            if (mSamplingProfiler) {
+                mSamplingProfiler->reset();
+            }
+        }
+
+        /**
+         * @return collected samples in collapsed stack (flamegraph) format.
+         */
+        [[nodiscard]]
+        std::string sampled_stacks_folded() const {
+            if (!mSamplingProfiler) {
+                return {};
+            }
+            return mSamplingProfiler->folded();
+        }
     };
 
     /**
@@ -317,7 +680,6 @@ namespace clg {
             init_global_functions();
         }
         ~vm() {
-            function::error_callback() = {};
             lua_close(*this);
         }
 
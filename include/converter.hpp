@@ -19,11 +19,49 @@ namespace clg {
     template<typename T, typename EnableIf=void>
     struct converter;
 
+    /**
+     * @brief Set of lua types, bit (lua_type() + 1) per type.
+     * @details
+     * A converter may declare the types its from_lua can accept as
+     * @code{cpp}
+     * static constexpr lua_type_mask lua_types = lua_type_bit(LUA_TTABLE);
+     * @endcode
+     * so register_function_overloaded skips overloads by the argument types without converting them. Converters without
+     * the declaration are tried for any type.
+     */
+    using lua_type_mask = unsigned;
+
+    constexpr lua_type_mask lua_type_bit(int type) noexcept {
+        return 1u << unsigned(type + 1);
+    }
+
+    static constexpr lua_type_mask any_lua_type = ~0u;
+
+    namespace detail {
+        template<typename T, typename EnableIf = void>
+        struct converter_lua_types {
+            static constexpr lua_type_mask value = any_lua_type;
+        };
+
+        template<typename T>
+        struct converter_lua_types<T, std::void_t<decltype(converter<T>::lua_types)>> {
+            static constexpr lua_type_mask value = converter<T>::lua_types;
+        };
+    }
+
+    /**
+     * @brief Lua types accepted by converter<T>::from_lua.
+     */
+    template<typename T>
+    static constexpr lua_type_mask converter_lua_types = detail::converter_lua_types<std::decay_t<T>>::value;
+
     template<typename T>
     struct converter<T, std::enable_if_t<std::is_integral_v<T> || std::is_floating_point_v<T> || std::is_enum_v<T>>> {
+        static constexpr lua_type_mask lua_types = lua_type_bit(LUA_TNUMBER) | lua_type_bit(LUA_TBOOLEAN) | lua_type_bit(LUA_TSTRING);
+
         static converter_result<T> from_lua(lua_State* l, int n) {
             if constexpr (std::is_integral_v<T> || std::is_floating_point_v<T> || std::is_enum_v<T>) {
-#ifdef lua_isinteger
+#if LUA_VERSION_NUM >= 503
                 if (lua_isinteger(l, n)) {
                     return static_cast<T>(lua_tointeger(l, n));
                 }
@@ -56,6 +94,8 @@ namespace clg {
 
     template<>
     struct converter<std::string> {
+        static constexpr lua_type_mask lua_types = lua_type_bit(LUA_TSTRING) | lua_type_bit(LUA_TNUMBER);
+
         static converter_result<std::string> from_lua(lua_State* l, int n) {
             if (!lua_isstring(l, n)) {
                 return converter_error{"not a string"};
@@ -71,6 +111,8 @@ namespace clg {
     };
     template<>
     struct converter<std::string_view> {
+        static constexpr lua_type_mask lua_types = lua_type_bit(LUA_TSTRING) | lua_type_bit(LUA_TNUMBER);
+
         static converter_result<std::string_view> from_lua(lua_State* l, int n) {
             if (!lua_isstring(l, n)) {
                 return converter_error{"not a string"};
@@ -87,6 +129,8 @@ namespace clg {
 
     template<>
     struct converter<lua_CFunction> {
+        static constexpr lua_type_mask lua_types = lua_type_bit(LUA_TFUNCTION);
+
         static converter_result<lua_CFunction> from_lua(lua_State* l, int n) {
             if (!lua_iscfunction(l, n)) {
                 return converter_error{"not a cfunction"};
@@ -101,6 +145,8 @@ namespace clg {
 
     template<>
     struct converter<const char*> {
+        static constexpr lua_type_mask lua_types = lua_type_bit(LUA_TSTRING) | lua_type_bit(LUA_TNUMBER);
+
         static converter_result<const char*> from_lua(lua_State* l, int n) {
             if (!lua_isstring(l, n)) {
                 return converter_error{"not a string"};
@@ -130,6 +176,8 @@ namespace clg {
 
     template<int N>
     struct converter<char[N]> {
+        static constexpr lua_type_mask lua_types = lua_type_bit(LUA_TSTRING) | lua_type_bit(LUA_TNUMBER);
+
         static converter_result<const char*> from_lua(lua_State* l, int n) {
             if (!lua_isstring(l, n)) {
                 return converter_error{"not a string"};
@@ -143,6 +191,8 @@ namespace clg {
     };
     template<>
     struct converter<bool> {
+        static constexpr lua_type_mask lua_types = lua_type_bit(LUA_TBOOLEAN);
+
         static converter_result<bool> from_lua(lua_State* l, int n) {
             if (!lua_isboolean(l, n)) {
                 return converter_error{"not a boolean"};
@@ -157,6 +207,8 @@ namespace clg {
 
     template<>
     struct converter<std::nullptr_t> {
+        static constexpr lua_type_mask lua_types = lua_type_bit(LUA_TNIL);
+
         static converter_result<std::nullptr_t> from_lua(lua_State* l, int n) {
             if (!lua_isnil(l, n)) {
                 return converter_error{"not a nil"};
@@ -224,29 +276,31 @@ namespace clg {
         return converter<T>::to_lua(l, value);
     }
 
+    /**
+     * @brief Pushes a temporary. Converters providing to_lua(lua_State*, T&&) (or taking T by value) consume it
+     * instead of copying, i.e. a std::tuple or std::vector returned from a binding.
+     */
+    template<typename T, typename = std::enable_if_t<!std::is_reference_v<T>>>
+    static int push_to_lua(lua_State* l, T&& value) {
+        clg::check_thread();
+        return converter<std::remove_cv_t<T>>::to_lua(l, std::move(value));
+    }
+
     template<typename... Args>
     struct converter<std::tuple<Args...>> {
         static int to_lua(lua_State* l, const std::tuple<Args...>& v) {
-            converter<std::tuple<Args...>> t(l);
-            (std::apply)([&](Args... a) {
-                t.push(std::forward<Args>(a)...);
+            (std::apply)([&](const auto&... a) {
+                (clg::push_to_lua(l, a), ...);
             }, v);
             return sizeof...(Args);
         }
 
-    private:
-        lua_State* mState;
-
-        converter(lua_State* state) : mState(state) {}
-
-        template<typename Arg, typename... MyArgs>
-        void push(Arg&& arg, MyArgs&&... args) {
-            push_to_lua(mState, arg);
-
-            push(std::forward<MyArgs>(args)...);
+        static int to_lua(lua_State* l, std::tuple<Args...>&& v) {
+            (std::apply)([&](auto&&... a) {
+                (clg::push_to_lua(l, std::forward<decltype(a)>(a)), ...);
+            }, std::move(v));
+            return sizeof...(Args);
         }
-
-        void push() {}
     };
 
     template<typename... Types>
@@ -273,6 +327,11 @@ namespace clg {
                 return clg::push_to_lua(l, v);
             }, types);
         }
+        static int to_lua(lua_State* l, std::variant<Types...>&& types) {
+            return std::visit([&](auto&& v) {
+                return clg::push_to_lua(l, std::forward<decltype(v)>(v));
+            }, std::move(types));
+        }
     };
 
 
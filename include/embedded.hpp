@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include <unordered_map>
+
+namespace clg {
+
+    /**
+     * @brief Precompiled chunk linked into the binary by clg_embed_scripts() (see cmake/clg_embed_scripts.cmake).
+     */
+    struct embedded_chunk {
+        std::string_view name;
+        const unsigned char* bytecode;
+        std::size_t size;
+    };
+
+    /**
+     * @brief Embedded chunks keyed by name. Filled by static initializers of the generated sources; read only afterwards.
+     */
+    inline std::unordered_map<std::string_view, embedded_chunk>& embedded_chunks() {
+        static std::unordered_map<std::string_view, embedded_chunk> chunks;
+        return chunks;
+    }
+
+    /**
+     * @return the embedded chunk or nullptr if there is no chunk with such name.
+     */
+    inline const embedded_chunk* find_embedded_chunk(std::string_view name) {
+        auto& chunks = embedded_chunks();
+        if (auto it = chunks.find(name); it != chunks.end()) {
+            return &it->second;
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Registers a chunk on static initialization. Used by the sources generated by clg_embed_scripts().
+     */
+    struct embedded_chunk_registrar {
+        embedded_chunk_registrar(std::string_view name, const unsigned char* bytecode, std::size_t size) {
+            embedded_chunks()[name] = embedded_chunk{ name, bytecode, size };
+        }
+    };
+}
@@ -11,6 +11,8 @@
 #include "converter.hpp"
 #include "ref.hpp"
 #include "dynamic_result.hpp"
+#include "profiler.hpp"
+#include <cstdio>
 
 namespace clg {
     class function {
@@ -23,15 +25,17 @@ namespace clg {
         function(clg::ref name) : mRef(std::move(name)) {}
 
         function() = default;
-        function(function&& rhs) noexcept: mRef(std::move(rhs.mRef)) {}
-        function(const function& rhs): mRef(rhs.mRef) {}
+        function(function&& rhs) noexcept: mRef(std::move(rhs.mRef)), mProfilerBinding(rhs.mProfilerBinding) {}
+        function(const function& rhs): mRef(rhs.mRef), mProfilerBinding(rhs.mProfilerBinding) {}
 
         function& operator=(function&& rhs) noexcept {
             mRef = std::move(rhs.mRef);
+            mProfilerBinding = rhs.mProfilerBinding;
             return *this;
         }
         function& operator=(std::nullptr_t rhs) noexcept {
             mRef = nullptr;
+            mProfilerBinding = nullptr;
             return *this;
         }
 
@@ -51,8 +55,13 @@ namespace clg {
         template<typename Return, typename... Args>
         Return call(Args&& ... args) const {
             const auto L = clg::state();
-            lua_settop(L, 0);
+            if constexpr (std::is_same_v < Return, clg::dynamic_result >) {
+                // dynamic_result takes every value on the stack
+                lua_settop(L, 0);
+            }
+            // values below are left untouched: called from a binding, they may be arguments the binding still uses
             stack_integrity_fix stack(L);
+            const int base = lua_gettop(L);
             push_function_to_be_called();
 
             push(std::forward<Args>(args)...);
@@ -64,7 +73,7 @@ namespace clg {
                 do_call(sizeof...(args), 0);
             } else {
                 do_call(sizeof...(args), 1);
-                if (lua_gettop(L) != 1) {
+                if (lua_gettop(L) != base + 1) {
                     throw clg::clg_exception(std::string("a function is expected to return ") + typeid(Return).name() + "; nothing returned");
                 }
                 return pop_from_lua<Return>(L);
@@ -96,6 +105,7 @@ namespace clg {
             const auto L = clg::state();
             // insert error handler before args
             int argsDelta = lua_gettop(L) - args;
+            profiler::call_scope profile(profiler::enabled() ? profiler_binding(L, argsDelta) : nullptr);
             lua_pushcfunction(L, error_handler);
             lua_insert(L, argsDelta);
 
@@ -107,7 +117,7 @@ namespace clg {
             lua_remove(L, argsDelta);
 
             if (status) {
-                lua_settop(L, 0);
+                lua_settop(L, argsDelta - 1);
                 throw lua_exception("failed to call " + mRef.debug_str());
             }
         }
@@ -129,6 +139,33 @@ namespace clg {
         }
 
     private:
+        /**
+         * @brief Profiler counters of the referenced function, resolved on the first profiled call.
+         */
+        mutable profiler::binding_stats* mProfilerBinding = nullptr;
+
+        profiler::binding_stats* profiler_binding(lua_State* L, int functionIndex) const {
+            if (!mProfilerBinding) {
+                mProfilerBinding = lua_binding(L, functionIndex);
+            }
+            return mProfilerBinding;
+        }
+
+        /**
+         * @brief Profiler counters of the lua function at the specified stack index, keyed by "source:line".
+         */
+        static profiler::binding_stats* lua_binding(lua_State* L, int functionIndex) {
+            if (!lua_isfunction(L, functionIndex)) {
+                return nullptr;
+            }
+            lua_Debug ar;
+            lua_pushvalue(L, functionIndex);
+            lua_getinfo(L, ">S", &ar);
+            char name[LUA_IDSIZE + 16];
+            std::snprintf(name, sizeof(name), "%s:%d", ar.short_src, ar.linedefined);
+            return &profiler::binding(name, profiler::direction::cpp_to_lua);
+        }
+
         static int error_handler(lua_State* l) {
             clg::impl::raii_state_updater u(l);
             if (error_callback()) {
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstdlib>
 #include <thread>
 #include <cassert>
@@ -17,30 +18,14 @@ extern "C" {
 
 namespace clg {
 
-    inline void check_thread() {
-        static std::thread::id threadId = std::this_thread::get_id();
-        assert(threadId == std::this_thread::get_id());
-    }
-
-    static bool is_in_exit_handler() {
-        // Lua seems feel bad on exit. Avoid unnecessary calls to Lua as the process is exiting anyway.
-        static bool v = false;
-        if (static bool once = true; once) {
-            once = false;
-            std::atexit([] {
-                v = true;
-                });
-        }
-        return v;
-    }
-
     namespace impl {
         /**
-         * @brief Storage of lua_State*.
+         * @brief Storage of lua_State*. Each thread tracks its own state, so independent states may run concurrently
+         * on different threads (one state must not be used by several threads simultaneously).
          * @note Do not use this directly, it's not raii safe. use raii_state_updater instead.
          */
         inline lua_State*& state() noexcept {
-            static lua_State* state = nullptr;
+            thread_local lua_State* state = nullptr;
             return state;
         }
 
@@ -54,6 +39,60 @@ namespace clg {
         private:
             lua_State* mOldState;
         };
+
+        /**
+         * @brief Thread driving a state. Set by state_interface; coroutines share the owner of their main state.
+         */
+        struct state_owner {
+            std::atomic<std::thread::id> thread{std::this_thread::get_id()};
+        };
+
+        /**
+         * @return owner of the state or nullptr if unknown (lua 5.1 and LuaJIT have no extra space to store it).
+         */
+        inline state_owner* owner_of(lua_State* L) noexcept {
+#if LUA_VERSION_NUM >= 503
+            // lua copies the extra space of the main state into every new coroutine
+            return *static_cast<state_owner**>(lua_getextraspace(L));
+#else
+            (void)L;
+            return nullptr;
+#endif
+        }
+
+        inline void set_owner(lua_State* L, state_owner* owner) noexcept {
+#if LUA_VERSION_NUM >= 503
+            *static_cast<state_owner**>(lua_getextraspace(L)) = owner;
+#else
+            (void)L;
+            (void)owner;
+#endif
+        }
+    }
+
+    /**
+     * @brief Checks that the calling thread drives a lua_State (see clg::impl::raii_state_updater) and that the state
+     * is owned by the calling thread (see state_interface::bind_to_current_thread). clg objects bound to a state
+     * (clg::ref, clg::function) must be used from the thread the state is bound to.
+     */
+    inline void check_thread() {
+        assert(impl::state() != nullptr && "no lua_State is bound to the calling thread");
+        assert((impl::owner_of(impl::state()) == nullptr ||
+                impl::owner_of(impl::state())->thread.load(std::memory_order_relaxed) == std::this_thread::get_id()) &&
+               "the lua_State is owned by another thread");
+    }
+
+    static bool is_in_exit_handler() {
+        // Lua seems feel bad on exit. Avoid unnecessary calls to Lua as the process is exiting anyway.
+        static std::atomic_bool v = false;
+        static const bool registered = [] {
+            std::atexit([] {
+                v = true;
+            });
+            return true;
+        }();
+        (void)registered;
+        return v.load(std::memory_order_relaxed);
     }
 
 
@@ -73,4 +112,102 @@ namespace clg {
 #define lua_pop(L,n) lua_settop(L, static_cast<int>(-(n)-1)) // silence overflow warning
 
 #undef luaL_newlibtable
-#define luaL_newlibtable(L,l) lua_createtable(L, 0, int(sizeof(l)/sizeof((l)[0]) - 1))
\ No newline at end of file
+#define luaL_newlibtable(L,l) lua_createtable(L, 0, int(sizeof(l)/sizeof((l)[0]) - 1))
+#if LUA_VERSION_NUM == 501
+// LuaJIT (Lua 5.1 API) compatibility for the Lua 5.2+ functions used by clg
+#ifndef LUA_OK
+#define LUA_OK 0
+#endif
+#define lua_rawlen(L,i) lua_objlen(L, (i))
+#define lua_pushglobaltable(L) lua_pushvalue(L, LUA_GLOBALSINDEX)
+#define lua_absindex(L,i) ((i) > 0 || (i) <= LUA_REGISTRYINDEX ? (i) : lua_gettop(L) + (i) + 1)
+#define lua_len(L,i) lua_pushinteger(L, lua_Integer(lua_objlen(L, (i))))
+#define LUA_OPEQ 0
+#define lua_compare(L,a,b,op) lua_equal(L, (a), (b))
+#define CLG_LUA_SEARCHERS "loaders"
+#else
+#define CLG_LUA_SEARCHERS "searchers"
+#endif
+
+// lua_dump takes the strip flag since 5.3; older versions always keep debug info
+#if LUA_VERSION_NUM >= 503
+#define CLG_LUA_DUMP(L,writer,data,strip) lua_dump(L, writer, data, strip)
+#else
+#define CLG_LUA_DUMP(L,writer,data,strip) lua_dump(L, writer, data)
+#endif
+
+namespace clg::impl {
+#if LUA_VERSION_NUM == 501
+    /**
+     * @brief Environment of userdata without a user value: 5.1 userdata environments can not be nil.
+     */
+    inline void push_no_user_value(lua_State* L) {
+        static char key;
+        lua_pushlightuserdata(L, &key);
+        lua_rawget(L, LUA_REGISTRYINDEX);
+        if (lua_isnil(L, -1)) {
+            lua_pop(L, 1);
+            lua_newtable(L);
+            lua_pushlightuserdata(L, &key);
+            lua_pushvalue(L, -2);
+            lua_rawset(L, LUA_REGISTRYINDEX);
+        }
+    }
+#endif
+
+    /**
+     * @brief Pushes a full userdata with room for one user value, initially nil.
+     */
+    inline void* new_userdata_uv(lua_State* L, std::size_t size) {
+#if LUA_VERSION_NUM >= 504
+        return lua_newuserdatauv(L, size, 1);
+#elif LUA_VERSION_NUM == 501
+        auto p = lua_newuserdata(L, size);
+        push_no_user_value(L);
+        lua_setfenv(L, -2);
+        return p;
+#else
+        return lua_newuserdata(L, size);
+#endif
+    }
+
+    /**
+     * @brief Pushes the user value of the userdata at the index.
+     * @return type of the pushed value
+     */
+    inline int get_user_value(lua_State* L, int index) {
+#if LUA_VERSION_NUM >= 504
+        return lua_getiuservalue(L, index, 1);
+#elif LUA_VERSION_NUM == 503
+        return lua_getuservalue(L, index);
+#elif LUA_VERSION_NUM == 502
+        lua_getuservalue(L, index);
+        return lua_type(L, -1);
+#else
+        index = lua_absindex(L, index);
+        lua_getfenv(L, index);
+        push_no_user_value(L);
+        const bool none = lua_rawequal(L, -1, -2);
+        lua_pop(L, 1);
+        if (none) {
+            lua_pop(L, 1);
+            lua_pushnil(L);
+            return LUA_TNIL;
+        }
+        return lua_type(L, -1);
+#endif
+    }
+
+    /**
+     * @brief Pops a value and sets it as the user value of the userdata at the index.
+     */
+    inline void set_user_value(lua_State* L, int index) {
+#if LUA_VERSION_NUM >= 504
+        lua_setiuservalue(L, index, 1);
+#elif LUA_VERSION_NUM >= 502
+        lua_setuservalue(L, index);
+#else
+        lua_setfenv(L, index);
+#endif
+    }
+}
@@ -10,8 +10,10 @@
 
 namespace clg {
     class lua_self;
+    class compact_lua_self;
     namespace impl {
         inline void invoke_handle_lua_virtual_func_assignment(clg::lua_self& s, std::string_view name, clg::ref value);
+        inline void invoke_handle_lua_virtual_func_assignment(clg::compact_lua_self& s, std::string_view name, clg::ref value);
     }
 
     namespace debug {
@@ -107,94 +109,380 @@ namespace clg {
     }
 
 
+    /**
+     * @brief Compact alternative to lua_self for objects which are passed to lua in large numbers.
+     * @details
+     * The object is represented in lua by a single userdata holding the shared_ptr. Fields added by lua code are kept
+     * in the user value of the userdata, a table which is created on the first write. While the userdata is alive and
+     * not :destroy()-ed, pushing the object again yields the same userdata (see detail::push_compact_object). Pushed as
+     * a more derived class than before, the userdata switches to the metatable of that class.
+     *
+     * Unlike lua_self, the fields live as long as the lua object: they are lost when it is collected while the C++
+     * object lives on.
+     * @code{cpp}
+     * class Entity: public clg::compact_lua_self {
+     * public:
+     *   // ...
+     * };
+     * @endcode
+     */
+    class compact_lua_self {
+        friend void impl::invoke_handle_lua_virtual_func_assignment(clg::compact_lua_self& s, std::string_view name, clg::ref value);
+    public:
+        virtual ~compact_lua_self() = default;
+
+    protected:
+        /**
+         * @return the lua object of this object in the current state or null if the object is not in lua.
+         */
+        clg::ref luaSelf() const noexcept;
+
+        /**
+         * @return table of the fields added by lua code or null if no fields were added.
+         */
+        clg::ref luaDataHolder() const noexcept;
+
+        virtual void handle_lua_virtual_func_assignment(std::string_view /* name */, clg::ref /* value */) {}
+    };
+    inline void impl::invoke_handle_lua_virtual_func_assignment(clg::compact_lua_self& s, std::string_view name, clg::ref value) {
+        s.handle_lua_virtual_func_assignment(name, std::move(value));
+    }
+
+
+    namespace detail {
+        /**
+         * @brief Pushes the registry table of the userdata of compact_lua_self objects keyed by object address. The
+         * values are weak, so the table does not keep the objects alive.
+         */
+        inline void push_compact_object_cache(lua_State* L) {
+            static char key;
+            lua_pushlightuserdata(L, &key);
+            lua_rawget(L, LUA_REGISTRYINDEX);
+            if (lua_istable(L, -1)) {
+                return;
+            }
+            lua_pop(L, 1);
+            lua_newtable(L);
+            lua_createtable(L, 0, 1);
+            lua_pushliteral(L, "v");
+            lua_setfield(L, -2, "__mode");
+            lua_setmetatable(L, -2);
+            lua_pushlightuserdata(L, &key);
+            lua_pushvalue(L, -2);
+            lua_rawset(L, LUA_REGISTRYINDEX);
+        }
+
+        /**
+         * @brief push_compact_object with the cache table (see push_compact_object_cache) already on the stack.
+         */
+        inline bool push_cached_compact_object(lua_State* L, int cacheIndex, const compact_lua_self* object) {
+            lua_pushlightuserdata(L, const_cast<compact_lua_self*>(object));
+            lua_rawget(L, cacheIndex);
+            if (auto helper = static_cast<shared_ptr_helper*>(lua_touserdata(L, -1))) {
+                // after :destroy() the object may be dead and its address reused by a new object
+                if (helper->ptr != nullptr) {
+                    return true;
+                }
+            }
+            lua_pop(L, 1);
+            return false;
+        }
+
+        /**
+         * @brief Pushes the userdata of the compact_lua_self object if it is in lua.
+         * @return false (nothing pushed) if the object has no userdata in this state.
+         */
+        inline bool push_compact_object(lua_State* L, const compact_lua_self* object) {
+            push_compact_object_cache(L);
+            const bool found = push_cached_compact_object(L, lua_gettop(L), object);
+            lua_remove(L, found ? -2 : -1);
+            return found;
+        }
+
+        /**
+         * @brief Stores the userdata on the top of the stack as the lua object of the compact_lua_self object.
+         */
+        inline void cache_compact_object(lua_State* L, int cacheIndex, const compact_lua_self* object) {
+            lua_pushlightuserdata(L, const_cast<compact_lua_self*>(object));
+            lua_pushvalue(L, -2);
+            lua_rawset(L, cacheIndex);
+        }
+
+        /**
+         * @brief Registry key of the metatable of class T, stored by class_registrar. The address of a per-type
+         * static serves as the type id, so no type name has to be built.
+         */
+        template<typename T>
+        void* class_metatable_key() noexcept {
+            static char key;
+            return &key;
+        }
+
+        /**
+         * @brief Registry key of the methods table of class T, stored by class_registrar.
+         */
+        template<typename T>
+        void* class_methods_key() noexcept {
+            static char key;
+            return &key;
+        }
+    }
+
+    inline clg::ref compact_lua_self::luaSelf() const noexcept {
+        const auto L = clg::state();
+        if (!detail::push_compact_object(L, this)) {
+            return nullptr;
+        }
+        return clg::ref::from_stack(L);
+    }
+
+    inline clg::ref compact_lua_self::luaDataHolder() const noexcept {
+        const auto L = clg::state();
+        if (!detail::push_compact_object(L, this)) {
+            return nullptr;
+        }
+        if (impl::get_user_value(L, -1) != LUA_TTABLE) {
+            lua_pop(L, 2);
+            return nullptr;
+        }
+        lua_remove(L, -2);
+        return clg::ref::from_stack(L);
+    }
+
     /**
      * userdata
      */
     template<typename T, typename EnableIf = void>
     struct converter_shared_ptr_impl {
         static constexpr bool use_lua_self = std::is_base_of_v<clg::lua_self, T>;
+        static constexpr bool use_compact_lua_self = std::is_base_of_v<clg::compact_lua_self, T>;
+        static_assert(!(use_lua_self && use_compact_lua_self), "extend either clg::lua_self or clg::compact_lua_self");
+
+        // lua_self objects are tables; anything else converts to nullptr
+        static constexpr lua_type_mask lua_types = use_lua_self ? any_lua_type
+                                                                : lua_type_bit(LUA_TNIL) | lua_type_bit(LUA_TUSERDATA) | lua_type_bit(LUA_TLIGHTUSERDATA);
 
         static converter_result<std::shared_ptr<T>> from_lua(lua_State* l, int n) {
-            if (lua_isnil(l, n)) {
+            auto helper = helper_from_lua(l, n);
+            if (helper.is_error()) {
+                return helper.error();
+            }
+            if (*helper == nullptr) {
                 return std::shared_ptr<T>(nullptr);
             }
+            return (*helper)->template as<T>();
+        }
+
+        /**
+         * @brief Finds the shared_ptr_helper of the object at the index without copying the shared_ptr.
+         * @return the helper or nullptr if the value does not hold an object (i.e. nil). The helper is kept alive by
+         * the value at the index.
+         */
+        static converter_result<shared_ptr_helper*> helper_from_lua(lua_State* l, int n) {
+            if (lua_isnil(l, n)) {
+                return static_cast<shared_ptr_helper*>(nullptr);
+            }
 
             if constexpr(use_lua_self) {
                 if (lua_istable(l, n)) {
-                    lua_getfield(l, n, "clg_strongref");
-                    if (!lua_isuserdata(l, -1)) {
-                        lua_pop(l, 1);
+                    n = lua_absindex(l, n);
+                    lua_pushliteral(l, "clg_strongref");
+                    lua_rawget(l, n);
+                    auto helper = static_cast<shared_ptr_helper*>(lua_touserdata(l, -1));
+                    lua_pop(l, 1);
+                    if (helper == nullptr) {
                         return clg::converter_error{"not a cpp object"};
                     }
-                    auto p = reinterpret_cast<shared_ptr_helper*>(lua_touserdata(l, -1))->as<T>();
-                    lua_pop(l, 1);
-                    return p;
+                    return helper;
                 }
-                return std::shared_ptr<T>(nullptr);
+                return static_cast<shared_ptr_helper*>(nullptr);
             } else {
                 if (lua_isuserdata(l, n)) {
-                    return reinterpret_cast<shared_ptr_helper*>(lua_touserdata(l, n))->as<T>();
+                    return static_cast<shared_ptr_helper*>(lua_touserdata(l, n));
                 }
                 return clg::converter_error{"not a userdata"};
             }
         }
 
-        static void push_shared_ptr_userdata(lua_State* l, std::shared_ptr<T> v) {
-            clg::stack_integrity_check c(l, 1);
+        /**
+         * @brief Pushes the metatable of class T or nil if the class is unknown in this state.
+         */
+        static void push_class_metatable(lua_State* l) {
+            lua_pushlightuserdata(l, detail::class_metatable_key<std::remove_cv_t<T>>());
+            lua_rawget(l, LUA_REGISTRYINDEX);
+            if (lua_istable(l, -1)) {
+                return;
+            }
+            lua_pop(l, 1);
+
+            // not registered with class_registrar in this state; use the metatable of the global class table if any
             auto classname = clg::class_name<T>();
-            auto t = reinterpret_cast<shared_ptr_helper*>(lua_newuserdata(l, sizeof(shared_ptr_helper)));
+#if LUA_VERSION_NUM != 501
+            auto r = lua_getglobal(l, classname.c_str());
+#else
+            lua_getglobal(l, classname.c_str());
+            auto r = lua_type(l, -1);
+#endif
+            if (r != LUA_TNIL)
+            {
+                if (lua_getmetatable(l, -1)) {
+                    lua_remove(l, -2);
+                    return;
+                }
+            }
+            lua_pop(l, 1);
+            lua_pushnil(l);
+        }
+
+        /**
+         * @brief Sets the metatable of class T to the userdata on the top of the stack.
+         */
+        static void set_class_metatable(lua_State* l) {
+            push_class_metatable(l);
+            if (lua_istable(l, -1)) {
+                lua_setmetatable(l, -2);
+            } else {
+                lua_pop(l, 1);
+            }
+        }
+
+        /**
+         * @brief Pushes a new userdata holding the object, without a metatable.
+         */
+        static void new_shared_ptr_userdata(lua_State* l, std::shared_ptr<T> v) {
+            void* storage;
+            if constexpr (use_compact_lua_self) {
+                // the user value holds the fields added by lua code
+                storage = impl::new_userdata_uv(l, sizeof(shared_ptr_helper));
+            } else {
+                storage = lua_newuserdata(l, sizeof(shared_ptr_helper));
+            }
+            auto t = reinterpret_cast<shared_ptr_helper*>(storage);
             if constexpr (use_lua_self) {
                 v->mUseCount = v;
             }
             auto ptr = v.get();
             new(t) shared_ptr_helper(std::move(v));
             if constexpr (use_lua_self) {
-                t->onDestroy = [ptr, helper = t] {
-                    if (helper == ptr->mHelper) {
-                        ptr->mHelper = nullptr;
+                t->onRelease = [](shared_ptr_helper& helper) noexcept {
+                    auto object = helper.as_ptr<T>();
+                    if (object.is_ok() && *object != nullptr && (*object)->mHelper == &helper) {
+                        (*object)->mHelper = nullptr;
                     }
                 };
                 if (ptr->mHelper != nullptr) {
                     // invalidate the old helper so it won't lead to memleak.
-                    ptr->mHelper->ptr = nullptr;
+                    ptr->mHelper->release();
                 }
                 ptr->mHelper = t;
             }
+        }
 
-#if LUA_VERSION_NUM != 501
-            auto r = lua_getglobal(l, classname.c_str());
-#else
-            lua_getglobal(l, classname.c_str());
-            auto r = lua_type(l, -1);
-#endif
-            if (r != LUA_TNIL)
-            {
-                if (lua_getmetatable(l, -1)) {
-                    lua_setmetatable(l, -3);
+        static void push_shared_ptr_userdata(lua_State* l, std::shared_ptr<T> v) {
+            clg::stack_integrity_check c(l, 1);
+            new_shared_ptr_userdata(l, std::move(v));
+            set_class_metatable(l);
+        }
+
+        /**
+         * @brief Pushes an array of the objects. Used by array_like_converter (i.e. std::vector<std::shared_ptr<T>>).
+         * @details
+         * The class metatable and the compact_lua_self object cache are looked up once for the whole array rather than
+         * per element. lua_self objects go through to_lua: each one is looked up by its own weak reference, only wrappers
+         * created for the first time would share the metatable lookup.
+         */
+        template<typename Container>
+        static int to_lua_array(lua_State* l, Container&& v, std::size_t size) {
+            constexpr bool consume = !std::is_lvalue_reference_v<Container>;
+            clg::stack_integrity_check c(l, 1);
+            lua_createtable(l, int(size), 0);
+            const int array = lua_gettop(l);
+
+            if constexpr (use_lua_self) {
+                for (std::size_t i = 0; i < size; ++i) {
+                    if constexpr (consume) {
+                        to_lua(l, std::move(v[i]));
+                    } else {
+                        to_lua(l, v[i]);
+                    }
+                    lua_rawseti(l, array, int(i + 1));
                 }
-                lua_pop(l, 1);
+                return 1;
+            }
+
+            push_class_metatable(l);
+            const int metatable = lua_gettop(l);
+            const bool hasMetatable = lua_istable(l, metatable);
+            int cache = 0;
+            if constexpr (use_compact_lua_self) {
+                detail::push_compact_object_cache(l);
+                cache = lua_gettop(l);
+            }
+
+            for (std::size_t i = 0; i < size; ++i) {
+                auto&& element = v[i];
+                if (element == nullptr) {
+                    continue;
+                }
+                if constexpr (use_compact_lua_self) {
+                    const compact_lua_self* object = element.get();
+                    if (detail::push_cached_compact_object(l, cache, object)) {
+                        if (retype_cached_compact_object(l, element) && hasMetatable) {
+                            lua_pushvalue(l, metatable);
+                            lua_setmetatable(l, -2);
+                        }
+                    } else {
+                        if constexpr (consume) {
+                            new_shared_ptr_userdata(l, std::move(element));
+                        } else {
+                            new_shared_ptr_userdata(l, element);
+                        }
+                        if (hasMetatable) {
+                            lua_pushvalue(l, metatable);
+                            lua_setmetatable(l, -2);
+                        }
+                        detail::cache_compact_object(l, cache, object);
+                    }
+                } else {
+                    if constexpr (consume) {
+                        new_shared_ptr_userdata(l, std::move(element));
+                    } else {
+                        new_shared_ptr_userdata(l, element);
+                    }
+                    if (hasMetatable) {
+                        lua_pushvalue(l, metatable);
+                        lua_setmetatable(l, -2);
+                    }
+                }
+                lua_rawseti(l, array, int(i + 1));
+            }
+            lua_settop(l, array);
+            return 1;
+        }
+
+        /**
+         * @brief Retypes the cached userdata on the top of the stack to T if T is declared to derive from the class it
+         * holds. The cache is keyed by object address only, so an object pushed as a base class first would otherwise
+         * keep the base class metatable when pushed as T. Pushing it as a base class or an unrelated class keeps the
+         * more derived type.
+         * @return true if retyped; the caller sets the metatable of T.
+         */
+        static bool retype_cached_compact_object(lua_State* l, const std::shared_ptr<T>& v) {
+            using type = std::remove_cv_t<T>;
+            auto helper = static_cast<shared_ptr_helper*>(lua_touserdata(l, -1));
+            if (!detail::declared_bases::contains(helper->typeId, detail::type_id<type>())) {
+                return false;
             }
+            helper->rebind(v);
+            return true;
         }
 
         static void push_weak_ptr_userdata(lua_State* l, std::weak_ptr<T> v) {
             clg::stack_integrity_check c(l, 1);
-            auto classname = clg::class_name<T>();
             auto t = reinterpret_cast<weak_ptr_helper*>(lua_newuserdata(l, sizeof(weak_ptr_helper)));
             new(t) weak_ptr_helper(std::move(v));
 
-#if LUA_VERSION_NUM != 501
-            auto r = lua_getglobal(l, classname.c_str());
-#else
-            lua_getglobal(l, classname.c_str());
-            auto r = lua_type(l, -1);
-#endif
-            if (r != LUA_TNIL)
-            {
-                if (lua_getmetatable(l, -1)) {
-                    lua_setmetatable(l, -3);
-                }
-                lua_pop(l, 1);
-            }
+            set_class_metatable(l);
         }
 
         static void push_strong_ref_holder_object(lua_State* l, std::shared_ptr<T> v, clg::ref dataHolderRef) {
@@ -261,7 +549,20 @@ namespace clg {
                 return 1;
             }
 
-            if constexpr(!use_lua_self) {
+            if constexpr (use_compact_lua_self) {
+                const compact_lua_self* object = v.get();
+                detail::push_compact_object_cache(l);
+                const int cache = lua_gettop(l);
+                if (detail::push_cached_compact_object(l, cache, object)) {
+                    if (retype_cached_compact_object(l, v)) {
+                        set_class_metatable(l);
+                    }
+                } else {
+                    push_shared_ptr_userdata(l, std::move(v));
+                    detail::cache_compact_object(l, cache, object);
+                }
+                lua_remove(l, cache);
+            } else if constexpr(!use_lua_self) {
                 push_shared_ptr_userdata(l, std::move(v));
             } else {
                 auto& weakRef = lua_self_shared_ptr_holder(*v);
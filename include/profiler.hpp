@@ -0,0 +1,229 @@
+#pragma once
+
+#include "lua.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace clg::profiler {
+
+    /**
+     * @brief Side of the boundary the call was made from.
+     */
+    enum class direction {
+        /**
+         * @brief Lua calls a registered C++ binding.
+         */
+        lua_to_cpp,
+
+        /**
+         * @brief C++ calls a Lua function through clg::function.
+         */
+        cpp_to_lua,
+    };
+
+    /**
+     * @brief Latency histogram bucket count. Bucket i holds calls which took [2^i; 2^(i+1)) nanoseconds, the last bucket
+     * also holds everything slower.
+     */
+    static constexpr std::size_t histogram_buckets = 32;
+
+    /**
+     * @brief Live counters of a single binding. Updated concurrently with relaxed atomics.
+     */
+    struct binding_stats {
+        std::string name;
+        profiler::direction direction;
+        std::atomic<std::uint64_t> calls{0};
+        std::atomic<std::uint64_t> totalNs{0};
+        std::array<std::atomic<std::uint64_t>, histogram_buckets> histogram{};
+
+        binding_stats(std::string name, profiler::direction direction): name(std::move(name)), direction(direction) {}
+
+        void record(std::uint64_t ns) noexcept {
+            calls.fetch_add(1, std::memory_order_relaxed);
+            totalNs.fetch_add(ns, std::memory_order_relaxed);
+            std::size_t bucket = 0;
+            while (ns > 1 && bucket + 1 < histogram_buckets) {
+                ns >>= 1;
+                ++bucket;
+            }
+            histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void reset() noexcept {
+            calls.store(0, std::memory_order_relaxed);
+            totalNs.store(0, std::memory_order_relaxed);
+            for (auto& b : histogram) {
+                b.store(0, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    /**
+     * @brief Copy of binding_stats taken by clg::profiler::snapshot().
+     */
+    struct binding_snapshot {
+        std::string name;
+        profiler::direction direction;
+        std::uint64_t calls;
+        std::uint64_t totalNs;
+        std::array<std::uint64_t, histogram_buckets> histogram;
+
+        [[nodiscard]]
+        double mean_ns() const noexcept {
+            return calls ? double(totalNs) / double(calls) : 0.0;
+        }
+
+        /**
+         * @brief Upper bound (in nanoseconds) of the histogram bucket containing the requested percentile.
+         * @param p percentile in [0; 1]
+         */
+        [[nodiscard]]
+        std::uint64_t percentile_ns(double p) const noexcept {
+            const auto target = std::uint64_t(double(calls) * p);
+            std::uint64_t accumulated = 0;
+            for (std::size_t i = 0; i < histogram_buckets; ++i) {
+                accumulated += histogram[i];
+                if (accumulated > target || accumulated == calls) {
+                    return std::uint64_t(1) << (i + 1);
+                }
+            }
+            return std::uint64_t(1) << histogram_buckets;
+        }
+    };
+
+    namespace impl {
+        inline std::atomic_bool& enabled_flag() noexcept {
+            static std::atomic_bool v = false;
+            return v;
+        }
+
+        struct registry {
+            std::mutex sync;
+            std::deque<binding_stats> storage; // deque keeps addresses stable
+            std::map<std::tuple<direction, std::string>, binding_stats*, std::less<>> byName;
+            std::unordered_map<lua_CFunction, const binding_stats*> byFunction;
+        };
+
+        inline registry& get_registry() {
+            static registry r;
+            return r;
+        }
+    }
+
+    /**
+     * @brief Whether bindings are timed. Off by default; when off, a call pays a single relaxed atomic load.
+     */
+    inline bool enabled() noexcept {
+        return impl::enabled_flag().load(std::memory_order_relaxed);
+    }
+
+    inline void set_enabled(bool enabled) noexcept {
+        impl::enabled_flag().store(enabled, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Finds or creates counters for a binding. The returned reference is valid until the process exits.
+     */
+    inline binding_stats& binding(std::string_view name, direction d) {
+        auto& r = impl::get_registry();
+        std::unique_lock lock(r.sync);
+        if (auto it = r.byName.find(std::make_tuple(d, name)); it != r.byName.end()) {
+            return *it->second;
+        }
+        auto& stats = r.storage.emplace_back(std::string(name), d);
+        r.byName.emplace(std::make_tuple(d, stats.name), &stats);
+        return stats;
+    }
+
+    /**
+     * @brief Associates the lua_CFunction implementing a binding with its counters, so stack samplers can name C frames.
+     */
+    inline void name_function(lua_CFunction function, const binding_stats& stats) {
+        auto& r = impl::get_registry();
+        std::unique_lock lock(r.sync);
+        r.byFunction.emplace(function, &stats);
+    }
+
+    /**
+     * @return the binding implemented by the function or nullptr if the function was never registered.
+     */
+    inline const binding_stats* function_binding(lua_CFunction function) {
+        auto& r = impl::get_registry();
+        std::unique_lock lock(r.sync);
+        if (auto it = r.byFunction.find(function); it != r.byFunction.end()) {
+            return it->second;
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Copies counters of every binding which was called at least once since the last reset().
+     */
+    inline std::vector<binding_snapshot> snapshot() {
+        auto& r = impl::get_registry();
+        std::unique_lock lock(r.sync);
+        std::vector<binding_snapshot> result;
+        result.reserve(r.storage.size());
+        for (const auto& s : r.storage) {
+            auto calls = s.calls.load(std::memory_order_relaxed);
+            if (calls == 0) {
+                continue;
+            }
+            auto& out = result.emplace_back(binding_snapshot{s.name, s.direction, calls, s.totalNs.load(std::memory_order_relaxed), {}});
+            for (std::size_t i = 0; i < histogram_buckets; ++i) {
+                out.histogram[i] = s.histogram[i].load(std::memory_order_relaxed);
+            }
+        }
+        return result;
+    }
+
+    /**
+     * @brief Zeroes counters of every binding.
+     */
+    inline void reset() {
+        auto& r = impl::get_registry();
+        std::unique_lock lock(r.sync);
+        for (auto& s : r.storage) {
+            s.reset();
+        }
+    }
+
+    /**
+     * @brief RAII timer of a single call. Does nothing when constructed with nullptr.
+     * @details
+     * A lua error raised inside the scope (i.e. by a binding calling luaL_error on its lua_State* argument) longjmps
+     * past the destructor, so such a call is not recorded. clg's own errors are raised after the scope is closed.
+     */
+    struct call_scope {
+    public:
+        explicit call_scope(binding_stats* stats) noexcept: mStats(stats) {
+            if (mStats) {
+                mBegin = std::chrono::steady_clock::now();
+            }
+        }
+
+        ~call_scope() {
+            if (mStats) {
+                mStats->record(std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - mBegin).count()));
+            }
+        }
+
+        call_scope(const call_scope&) = delete;
+        call_scope& operator=(const call_scope&) = delete;
+
+    private:
+        binding_stats* mStats;
+        std::chrono::steady_clock::time_point mBegin;
+    };
+}
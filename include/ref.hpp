@@ -16,10 +16,14 @@ namespace clg {
             // https://github.com/ThePhD/sol2/blob/e8e122e9ce46f4f1c0b04003d8b703fe1b89755a/include/sol/reference.hpp#L220
             if (L_ == nullptr)
                 return backup_if_unsupported_;
+#if LUA_VERSION_NUM == 501
+            return backup_if_unsupported_; // the main thread is not stored in the registry
+#else
             lua_rawgeti(L_, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
             lua_State* Lmain = lua_tothread(L_, -1);
             lua_pop(L_, 1);
             return Lmain;
+#endif
         }
 	}
     class ref {
@@ -32,8 +36,8 @@ namespace clg {
                 return incRef();
             }
             return -1;
-        }()) {}
-        ref(ref&& other) noexcept: mPtr(other.mPtr) {
+        }()), mOwner(other.mOwner) {}
+        ref(ref&& other) noexcept: mPtr(other.mPtr), mOwner(other.mOwner) {
             other.mPtr = -1;
         }
 
@@ -47,6 +51,7 @@ namespace clg {
 
         ref& operator=(ref&& other) noexcept {
             mPtr = other.mPtr;
+            mOwner = other.mOwner;
             other.mPtr = -1;
             return *this;
         }
@@ -60,6 +65,7 @@ namespace clg {
                 }
                 return -1;
             }();
+            mOwner = other.mOwner;
             return *this;
         }
 
@@ -102,6 +108,7 @@ namespace clg {
 
         void push_value_to_stack(lua_State* l = clg::state()) const noexcept {
             assert(l != nullptr);
+            assert((isNull() || mOwner == impl::owner_of(l)) && "clg::ref is used with a state it does not belong to");
             lua_rawgeti(l, LUA_REGISTRYINDEX, mPtr);
         }
 
@@ -200,9 +207,15 @@ namespace clg {
     private:
         int mPtr = -1;
 
+        /**
+         * @brief Owner of the state the reference belongs to; checked in debug builds.
+         */
+        impl::state_owner* mOwner = nullptr;
+
         void releaseIfNotNull() {
             if (mPtr != -1 && !clg::is_in_exit_handler()) {
                 clg::check_thread();
+                assert(mOwner == impl::owner_of(clg::state()) && "clg::ref is released in a state it does not belong to");
                 luaL_unref(clg::state(), LUA_REGISTRYINDEX, mPtr);
             }
         }
@@ -217,7 +230,7 @@ namespace clg {
             return r;
         }
 
-        ref(lua_State* state) noexcept: mPtr(incRef()) {
+        ref(lua_State* state) noexcept: mPtr(incRef()), mOwner(impl::owner_of(state)) {
         }
     };
 
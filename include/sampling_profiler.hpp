@@ -0,0 +1,171 @@
+#pragma once
+
+#include "lua.hpp"
+#include "profiler.hpp"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+namespace clg {
+
+    /**
+     * @brief Samples the running Lua call stack every N executed Lua instructions (lua_sethook count hook) and aggregates
+     * the samples into collapsed stacks, the input format of flamegraph.pl and similar tools.
+     * @details
+     * Lua frames are named "function source:line"; C frames of registered bindings are named by their clg::profiler
+     * name (i.e. "Class:method"). Since the hook counts Lua instructions, time spent inside C++ is not sampled by itself;
+     * C++ bindings appear in stacks when they call back into Lua.
+     *
+     * Replaces any lua_sethook hook installed on the state while running.
+     */
+    class sampling_profiler {
+    public:
+        /**
+         * @brief Maximum number of frames recorded per sample, the outermost frames are dropped.
+         */
+        static constexpr int max_depth = 64;
+
+        explicit sampling_profiler(lua_State* state): mState(state) {}
+
+        ~sampling_profiler() {
+            stop();
+        }
+
+        sampling_profiler(const sampling_profiler&) = delete;
+        sampling_profiler& operator=(const sampling_profiler&) = delete;
+
+        /**
+         * @param instructionInterval number of Lua instructions between two samples.
+         */
+        void start(int instructionInterval) {
+            lua_pushlightuserdata(mState, registry_key());
+            lua_pushlightuserdata(mState, this);
+            lua_rawset(mState, LUA_REGISTRYINDEX);
+            lua_sethook(mState, hook, LUA_MASKCOUNT, instructionInterval);
+            mRunning = true;
+        }
+
+        void stop() noexcept {
+            if (!mRunning) {
+                return;
+            }
+            mRunning = false;
+            lua_sethook(mState, nullptr, 0, 0);
+            lua_pushlightuserdata(mState, registry_key());
+            lua_pushnil(mState);
+            lua_rawset(mState, LUA_REGISTRYINDEX);
+        }
+
+        [[nodiscard]]
+        bool running() const noexcept {
+            return mRunning;
+        }
+
+        /**
+         * @brief Sample counts keyed by "outermost;...;innermost" stack.
+         */
+        [[nodiscard]]
+        const std::unordered_map<std::string, std::size_t>& samples() const noexcept {
+            return mSamples;
+        }
+
+        /**
+         * @return samples in collapsed stack format, one "outermost;...;innermost count" line per stack.
+         */
+        [[nodiscard]]
+        std::string folded() const {
+            std::string result;
+            for (const auto& [stack, count] : mSamples) {
+                result += stack;
+                result += ' ';
+                result += std::to_string(count);
+                result += '\n';
+            }
+            return result;
+        }
+
+        void reset() noexcept {
+            mSamples.clear();
+        }
+
+    private:
+        lua_State* mState;
+        bool mRunning = false;
+        std::unordered_map<std::string, std::size_t> mSamples;
+        std::string mStackBuffer;
+
+        static void* registry_key() noexcept {
+            static char key;
+            return &key;
+        }
+
+        static void hook(lua_State* L, lua_Debug*) {
+            lua_pushlightuserdata(L, registry_key());
+            lua_rawget(L, LUA_REGISTRYINDEX);
+            auto self = static_cast<sampling_profiler*>(lua_touserdata(L, -1));
+            lua_pop(L, 1);
+            if (!self) {
+                return;
+            }
+            try {
+                self->sample(L);
+            } catch (...) {
+                // exceptions must not cross the lua frames which called the hook
+                lua_sethook(L, nullptr, 0, 0);
+                self->stop();
+            }
+        }
+
+        void sample(lua_State* L) {
+            lua_Debug frames[max_depth];
+            int depth = 0;
+            while (depth < max_depth && lua_getstack(L, depth, &frames[depth])) {
+                ++depth;
+            }
+
+            mStackBuffer.clear();
+            char frameName[LUA_IDSIZE + 128];
+            for (int level = depth - 1; level >= 0; --level) {
+                auto& ar = frames[level];
+                lua_getinfo(L, "Snf", &ar);
+                frame_name(L, ar, frameName, sizeof(frameName));
+                lua_pop(L, 1);
+                if (!mStackBuffer.empty()) {
+                    mStackBuffer += ';';
+                }
+                mStackBuffer += frameName;
+            }
+
+            if (auto it = mSamples.find(mStackBuffer); it != mSamples.end()) {
+                ++it->second;
+            } else {
+                mSamples.emplace(mStackBuffer, 1);
+            }
+        }
+
+        /**
+         * @brief Names the frame whose function is on the top of the stack.
+         */
+        static void frame_name(lua_State* L, const lua_Debug& ar, char* out, std::size_t size) {
+            if (lua_iscfunction(L, -1)) {
+                if (auto binding = profiler::function_binding(lua_tocfunction(L, -1))) {
+                    std::snprintf(out, size, "%s", binding->name.c_str());
+                } else {
+                    std::snprintf(out, size, "%s [C]", ar.name ? ar.name : "?");
+                }
+            } else if (std::strcmp(ar.what, "main") == 0) {
+                std::snprintf(out, size, "main %s", ar.short_src);
+            } else {
+                std::snprintf(out, size, "%s %s:%d", ar.name ? ar.name : "?", ar.short_src, ar.linedefined);
+            }
+
+            // ';' separates frames in the collapsed stack format
+            for (auto c = out; *c; ++c) {
+                if (*c == ';') {
+                    *c = ':';
+                }
+            }
+        }
+    };
+}
@@ -4,10 +4,16 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <deque>
 #include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <utility>
 #include <variant>
+#include <vector>
 
 namespace clg {
     struct converter_error {
@@ -75,46 +81,290 @@ namespace clg {
         };
     }
 
+    namespace detail {
+        inline std::uint32_t next_type_id() noexcept {
+            static std::atomic<std::uint32_t> counter = 0;
+            return ++counter;
+        }
+
+        /**
+         * @brief Small integer identifying type T, assigned on first use. Cheaper to store and compare than
+         * std::type_info.
+         */
+        template<typename T>
+        std::uint32_t type_id() noexcept {
+            static const std::uint32_t id = next_type_id();
+            return id;
+        }
+
+        template<typename From, typename To, typename = void>
+        struct is_static_castable: std::false_type {};
+        template<typename From, typename To>
+        struct is_static_castable<From, To, std::void_t<decltype(static_cast<To>(std::declval<From>()))>>: std::true_type {};
+
+        /**
+         * @brief Converts the pointer stored in shared_ptr_helper back to T*; allow_lua_inheritance types are stored
+         * as allow_lua_inheritance*.
+         */
+        template<typename T>
+        T* from_stored_ptr(void* p) noexcept {
+            if constexpr (std::is_base_of_v<allow_lua_inheritance, T>) {
+                auto inheritance = static_cast<allow_lua_inheritance*>(p);
+                if constexpr (is_static_castable<allow_lua_inheritance*, T*>::value) {
+                    return static_cast<T*>(inheritance);
+                } else {
+                    // allow_lua_inheritance is a virtual base of T
+                    return dynamic_cast<T*>(inheritance);
+                }
+            } else {
+                return static_cast<T*>(p);
+            }
+        }
+
+        struct derived_cast {
+            std::uint32_t derivedId;
+
+            /**
+             * @brief Converts the stored pointer of the derived class to the base class.
+             */
+            void* (*cast)(void* stored) noexcept;
+        };
+
+        /**
+         * @brief Base and derived type id pairs declared with class_registrar::bases, for checks where the base class is
+         * only known by its id. Read without locking like derived_casts.
+         */
+        class declared_bases {
+        public:
+            static bool contains(std::uint32_t baseId, std::uint32_t derivedId) noexcept {
+                if (auto table = current().load(std::memory_order_acquire)) {
+                    for (const auto& [base, derived] : *table) {
+                        if (base == baseId && derived == derivedId) {
+                            return true;
+                        }
+                    }
+                }
+                return false;
+            }
+
+            static void add(std::uint32_t baseId, std::uint32_t derivedId) {
+                std::unique_lock lock(sync());
+                std::vector<std::pair<std::uint32_t, std::uint32_t>> table;
+                if (auto old = current().load(std::memory_order_relaxed)) {
+                    table = *old;
+                }
+                table.emplace_back(baseId, derivedId);
+                current().store(&versions().emplace_back(std::move(table)), std::memory_order_release);
+            }
+
+        private:
+            static std::atomic<const std::vector<std::pair<std::uint32_t, std::uint32_t>>*>& current() noexcept {
+                static std::atomic<const std::vector<std::pair<std::uint32_t, std::uint32_t>>*> v = nullptr;
+                return v;
+            }
+
+            static std::mutex& sync() noexcept {
+                static std::mutex v;
+                return v;
+            }
+
+            static std::deque<std::vector<std::pair<std::uint32_t, std::uint32_t>>>& versions() noexcept {
+                static std::deque<std::vector<std::pair<std::uint32_t, std::uint32_t>>> v;
+                return v;
+            }
+        };
+
+        /**
+         * @brief Classes declared to derive from Base with class_registrar::bases.
+         * @details
+         * Conversions read the table without locking: registration publishes a new immutable copy of it and keeps the
+         * old ones alive.
+         */
+        template<typename Base>
+        class derived_casts {
+        public:
+            static const derived_cast* find(std::uint32_t derivedId) noexcept {
+                if (auto table = current().load(std::memory_order_acquire)) {
+                    for (const auto& e : *table) {
+                        if (e.derivedId == derivedId) {
+                            return &e;
+                        }
+                    }
+                }
+                return nullptr;
+            }
+
+            template<typename Derived>
+            static void add() {
+                static_assert(std::is_base_of_v<Base, Derived> && !std::is_same_v<Base, Derived>, "not a base class");
+                static const bool added = [] {
+                    std::unique_lock lock(sync());
+                    std::vector<derived_cast> table;
+                    if (auto old = current().load(std::memory_order_relaxed)) {
+                        table = *old;
+                    }
+                    table.push_back({ type_id<Derived>(), cast<Derived> });
+                    current().store(&versions().emplace_back(std::move(table)), std::memory_order_release);
+                    declared_bases::add(type_id<Base>(), type_id<Derived>());
+                    return true;
+                }();
+                (void)added;
+            }
+
+        private:
+            template<typename Derived>
+            static void* cast(void* stored) noexcept {
+                return static_cast<Base*>(from_stored_ptr<Derived>(stored));
+            }
+
+            static std::atomic<const std::vector<derived_cast>*>& current() noexcept {
+                static std::atomic<const std::vector<derived_cast>*> v = nullptr;
+                return v;
+            }
+
+            static std::mutex& sync() noexcept {
+                static std::mutex v;
+                return v;
+            }
+
+            static std::deque<std::vector<derived_cast>>& versions() noexcept {
+                static std::deque<std::vector<derived_cast>> v;
+                return v;
+            }
+        };
+    }
+
     struct shared_ptr_helper: impl::ptr_helper {
         std::shared_ptr<void> ptr;
-        const std::type_info& type;
-        std::weak_ptr<void> weakPtr;
-        std::function<void()> onDestroy;
+
+        /**
+         * @brief Called with the object still alive when the helper drops its strong reference (release() or
+         * destruction).
+         */
+        void (*onRelease)(shared_ptr_helper& self) noexcept = nullptr;
+
+        /**
+         * @brief detail::type_id of the stored type.
+         */
+        std::uint32_t typeId;
+
+        /**
+         * @brief Number of method calls borrowing the object (see as_ptr). Lua states are single threaded, so a plain
+         * counter is enough.
+         */
+        unsigned borrowCount = 0;
+
+        /**
+         * @brief release() was called while the object was borrowed.
+         */
+        bool releasePending = false;
+
+        /**
+         * @brief The stored type extends allow_lua_inheritance, i.e. ptr holds allow_lua_inheritance*.
+         */
+        bool inheritable;
 
 
         template<typename T>
         shared_ptr_helper(std::shared_ptr<T> ptr):
             ptr(convert_to_void_p(std::move(ptr))),
-            type(typeid(T)),
-            weakPtr(ptr)
+            typeId(detail::type_id<std::remove_cv_t<T>>()),
+            inheritable(std::is_base_of_v<allow_lua_inheritance, T>)
         {
         }
         ~shared_ptr_helper() {
-            if (onDestroy) onDestroy();
+            drop();
         }
 
         template<typename T>
         clg::converter_result<std::shared_ptr<T>> as() {
-            if (ptr == nullptr) {
-                ptr = weakPtr.lock();
+            auto p = as_ptr<T>();
+            if (p.is_error()) {
+                return p.error();
+            }
+            if (*p == nullptr) {
+                return std::shared_ptr<T>(nullptr);
             }
+            return std::shared_ptr<T>(ptr, *p);
+        }
+
+        /**
+         * @brief Like as(), but returns a raw pointer without copying the shared_ptr (no refcount operations). The
+         * object is owned by this helper; use begin_borrow/end_borrow to keep it alive while the pointer is used.
+         * @details
+         * The stored class and the bases declared with class_registrar::bases are found by type id. Other conversions
+         * of allow_lua_inheritance types (i.e. to a derived class) fall back to dynamic_cast.
+         */
+        template<typename T>
+        clg::converter_result<T*> as_ptr() {
+            using type = std::remove_cv_t<T>;
             if (ptr == nullptr) {
                 return clg::converter_error{":destroy()-ed cpp object"};
             }
+            if (typeId == detail::type_id<type>()) {
+                return detail::from_stored_ptr<type>(ptr.get());
+            }
+            if (auto base = detail::derived_casts<type>::find(typeId)) {
+                return static_cast<type*>(base->cast(ptr.get()));
+            }
             if constexpr (std::is_base_of_v<allow_lua_inheritance, T>) {
-                auto inheritance = reinterpret_cast<const std::shared_ptr<allow_lua_inheritance>&>(ptr);
-                return std::dynamic_pointer_cast<T>(inheritance);
-            } else {
-                if (auto& expected = typeid(T); expected != type) {
-                    static std::string e = std::string("type mismatch: expected ") + expected.name() + "\nnote: extend clg::allow_lua_inheritance to allow inheritance";
-                    return converter_error{e.c_str()};
+                if (inheritable) {
+                    return dynamic_cast<type*>(static_cast<allow_lua_inheritance*>(ptr.get()));
                 }
-                return reinterpret_cast<const std::shared_ptr<T>&>(ptr);
             }
+            return type_mismatch<T>();
+        }
+
+        /**
+         * @brief Makes the helper hold the object as T (i.e. a more derived class of the same object).
+         */
+        template<typename T>
+        void rebind(std::shared_ptr<T> object) {
+            ptr = convert_to_void_p(std::move(object));
+            typeId = detail::type_id<std::remove_cv_t<T>>();
+            inheritable = std::is_base_of_v<allow_lua_inheritance, T>;
+        }
+
+        void begin_borrow() noexcept {
+            ++borrowCount;
+        }
+
+        void end_borrow() noexcept {
+            if (--borrowCount == 0 && releasePending) {
+                releasePending = false;
+                drop();
+            }
+        }
+
+        /**
+         * @brief Drops the strong reference, or defers it until the last borrowing call returns.
+         */
+        void release() noexcept {
+            if (borrowCount > 0) {
+                releasePending = true;
+                return;
+            }
+            drop();
         }
 
     private:
 
+        void drop() noexcept {
+            if (ptr == nullptr) {
+                return;
+            }
+            if (onRelease) {
+                onRelease(*this);
+            }
+            ptr = nullptr;
+        }
+
+        template<typename T>
+        static converter_error type_mismatch() {
+            static std::string e = std::string("type mismatch: expected ") + typeid(T).name() + "\nnote: declare bases with class_registrar::bases or extend clg::allow_lua_inheritance";
+            return converter_error{e.c_str()};
+        }
+
         template<typename T>
         std::shared_ptr<void> convert_to_void_p(std::shared_ptr<T> ptr) {
             if constexpr (std::is_base_of_v<allow_lua_inheritance, T>) {
@@ -61,6 +61,8 @@ namespace clg {
 
     template<>
     struct converter<clg::table> {
+        static constexpr lua_type_mask lua_types = lua_type_bit(LUA_TTABLE);
+
         static clg::converter_result<clg::table> from_lua(lua_State* l, int n) noexcept {
             clg::stack_integrity_check c(l);
             if (!lua_istable(l, n)) {
@@ -105,6 +107,16 @@ namespace clg {
         }
     };
 
+    namespace detail {
+        /**
+         * @brief Converter pushes whole arrays of its type at once (see converter_shared_ptr_impl::to_lua_array).
+         */
+        template<typename Converter, typename Container, typename = void>
+        struct has_to_lua_array: std::false_type {};
+        template<typename Converter, typename Container>
+        struct has_to_lua_array<Converter, Container, std::void_t<decltype(Converter::to_lua_array(std::declval<lua_State*>(), std::declval<Container>(), std::size_t{}))>>: std::true_type {};
+    }
+
     template<typename Container, typename Helper> /* requires requires (Container container) {
         container[0]; // requires operator[](int index) value access method
 
@@ -119,6 +131,8 @@ namespace clg {
         // determines container element type
         using element_t = std::decay_t<decltype(std::declval<Container>()[0])>;
 
+        static constexpr lua_type_mask lua_types = lua_type_bit(LUA_TTABLE);
+
         static clg::converter_result<Container> from_lua(lua_State* l, int n) {
             clg::stack_integrity_check c(l);
             if (!lua_istable(l, n)) {
@@ -165,6 +179,9 @@ namespace clg {
 
         static int to_lua(lua_State* l, const Container& v) {
             auto s = Helper::size(v);
+            if constexpr (detail::has_to_lua_array<converter<element_t>, const Container&>::value) {
+                return converter<element_t>::to_lua_array(l, v, s);
+            }
             lua_createtable(l, s, 0);
 
             for (unsigned i = 0; i < s; ++i) {
@@ -173,6 +190,20 @@ namespace clg {
             }
             return 1;
         }
+
+        static int to_lua(lua_State* l, Container&& v) {
+            auto s = Helper::size(v);
+            if constexpr (detail::has_to_lua_array<converter<element_t>, Container&&>::value) {
+                return converter<element_t>::to_lua_array(l, std::move(v), s);
+            }
+            lua_createtable(l, s, 0);
+
+            for (unsigned i = 0; i < s; ++i) {
+                clg::push_to_lua(l, static_cast<element_t&&>(v[i]));
+                lua_rawseti(l, -2, i + 1);
+            }
+            return 1;
+        }
     };
 
     namespace detail {
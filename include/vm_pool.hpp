@@ -0,0 +1,239 @@
+#pragma once
+
+#include "clg.hpp"
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace clg {
+
+    /**
+     * @brief Set of pre-initialized clg::vm handed out to worker threads.
+     * @details
+     * Each vm runs the initializer once (class registrations, do_file of common modules, ...). The globals table and
+     * package.loaded are snapshotted afterwards; when a vm is returned to the pool, globals added by the borrower are
+     * removed and overwritten ones are restored (shallow: tables reachable from the globals are not restored).
+     *
+     * Nothing else is restored: metatables (including those of strings and classes registered by the initializer), the
+     * registry and the contents of snapshotted tables keep whatever the borrower left in them. Scripts sharing a pool
+     * must not modify them, or the next borrower sees the changes.
+     *
+     * @code{cpp}
+     * clg::vm_pool pool(std::thread::hardware_concurrency(), [](clg::vm& vm) {
+     *     vm.register_class<Entity>()...;
+     *     vm.do_file("scripts/common.lua");
+     * });
+     * ...
+     * // on a worker thread
+     * auto vm = pool.checkout();
+     * vm->do_string("handle_request()");
+     * @endcode
+     */
+    class vm_pool {
+    private:
+        struct slot {
+            std::unique_ptr<clg::vm> vm;
+            int globals = LUA_NOREF;
+            int loaded = LUA_NOREF;
+        };
+
+    public:
+        using initializer = std::function<void(clg::vm& vm)>;
+
+        /**
+         * @brief A vm checked out of the pool, bound to the calling thread until the lease is destroyed.
+         * @note The lease must be destroyed on the thread which checked it out.
+         */
+        class lease {
+            friend class vm_pool;
+        public:
+            ~lease() {
+                mPool.give_back(mSlot);
+            }
+
+            lease(const lease&) = delete;
+            lease& operator=(const lease&) = delete;
+
+            clg::vm& operator*() const noexcept {
+                return *mSlot.vm;
+            }
+
+            clg::vm* operator->() const noexcept {
+                return mSlot.vm.get();
+            }
+
+        private:
+            vm_pool& mPool;
+            slot& mSlot;
+            impl::raii_state_updater mStateUpdater;
+
+            lease(vm_pool& pool, slot& s): mPool(pool), mSlot(s), mStateUpdater(bind(s)) {}
+
+            static lua_State* bind(slot& s) noexcept {
+                s.vm->bind_to_current_thread();
+                return *s.vm;
+            }
+        };
+
+        vm_pool(std::size_t size, initializer init) {
+            mSlots.reserve(size);
+            mFree.reserve(size);
+            try {
+                for (std::size_t i = 0; i < size; ++i) {
+                    auto& s = *mSlots.emplace_back(std::make_unique<slot>());
+                    impl::raii_state_updater restoreState(impl::state()); // clg::vm binds itself to the thread
+                    s.vm = std::make_unique<clg::vm>();
+                    if (init) {
+                        init(*s.vm);
+                    }
+                    lua_State* L = *s.vm;
+                    lua_settop(L, 0);
+                    lua_pushglobaltable(L);
+                    s.globals = snapshot(L, -1);
+                    lua_pop(L, 1);
+                    if (push_package_loaded(L)) {
+                        s.loaded = snapshot(L, -1);
+                        lua_pop(L, 1);
+                    }
+                    mFree.push_back(&s);
+                }
+            } catch (...) {
+                destroy();
+                throw;
+            }
+        }
+
+        ~vm_pool() {
+            destroy();
+        }
+
+        vm_pool(const vm_pool&) = delete;
+        vm_pool& operator=(const vm_pool&) = delete;
+
+        /**
+         * @brief Takes a vm out of the pool, waiting until one is available.
+         */
+        [[nodiscard]]
+        lease checkout() {
+            std::unique_lock lock(mSync);
+            mReturned.wait(lock, [&] { return !mFree.empty(); });
+            auto s = mFree.back();
+            mFree.pop_back();
+            lock.unlock();
+            return lease(*this, *s);
+        }
+
+        [[nodiscard]]
+        std::size_t size() const noexcept {
+            return mSlots.size();
+        }
+
+        [[nodiscard]]
+        std::size_t available() const {
+            std::unique_lock lock(mSync);
+            return mFree.size();
+        }
+
+    private:
+        std::vector<std::unique_ptr<slot>> mSlots;
+        std::vector<slot*> mFree;
+        mutable std::mutex mSync;
+        std::condition_variable mReturned;
+
+        void give_back(slot& s) noexcept {
+            lua_State* L = *s.vm;
+            lua_settop(L, 0);
+            lua_pushglobaltable(L);
+            restore(L, s.globals);
+            lua_pop(L, 1);
+            if (s.loaded != LUA_NOREF && push_package_loaded(L)) {
+                restore(L, s.loaded);
+                lua_pop(L, 1);
+            }
+            {
+                std::unique_lock lock(mSync);
+                mFree.push_back(&s);
+            }
+            mReturned.notify_one();
+        }
+
+        void destroy() noexcept {
+            // vms are destroyed in reverse order of creation on the calling thread
+            for (auto it = mSlots.rbegin(); it != mSlots.rend(); ++it) {
+                auto& s = **it;
+                if (!s.vm) {
+                    continue;
+                }
+                s.vm->bind_to_current_thread();
+                impl::raii_state_updater bindState(static_cast<lua_State*>(*s.vm));
+                s.vm.reset();
+            }
+            mSlots.clear();
+        }
+
+        static bool push_package_loaded(lua_State* L) {
+            lua_getglobal(L, "package");
+            if (!lua_istable(L, -1)) {
+                lua_pop(L, 1);
+                return false;
+            }
+            lua_getfield(L, -1, "loaded");
+            lua_remove(L, -2);
+            if (!lua_istable(L, -1)) {
+                lua_pop(L, 1);
+                return false;
+            }
+            return true;
+        }
+
+        /**
+         * @return registry reference to a shallow copy of the table at the specified index.
+         */
+        static int snapshot(lua_State* L, int index) {
+            index = lua_absindex(L, index);
+            lua_newtable(L);
+            lua_pushnil(L);
+            while (lua_next(L, index) != 0) {
+                lua_pushvalue(L, -2);
+                lua_insert(L, -2);
+                lua_rawset(L, -4);
+            }
+            return luaL_ref(L, LUA_REGISTRYINDEX);
+        }
+
+        /**
+         * @brief Makes the table on the top of the stack a shallow copy of the snapshot again.
+         */
+        static void restore(lua_State* L, int snapshotRef) {
+            const int table = lua_gettop(L);
+            lua_rawgeti(L, LUA_REGISTRYINDEX, snapshotRef);
+            const int snapshot = lua_gettop(L);
+
+            // remove keys which are not in the snapshot. Clearing existing fields during traversal is allowed.
+            lua_pushnil(L);
+            while (lua_next(L, table) != 0) {
+                lua_pop(L, 1);
+                lua_pushvalue(L, -1);
+                lua_rawget(L, snapshot);
+                const bool added = lua_isnil(L, -1);
+                lua_pop(L, 1);
+                if (added) {
+                    lua_pushvalue(L, -1);
+                    lua_pushnil(L);
+                    lua_rawset(L, table);
+                }
+            }
+
+            // restore overwritten and removed values
+            lua_pushnil(L);
+            while (lua_next(L, snapshot) != 0) {
+                lua_pushvalue(L, -2);
+                lua_insert(L, -2);
+                lua_rawset(L, table);
+            }
+            lua_pop(L, 1);
+        }
+    };
+}
@@ -0,0 +1,138 @@
+#include "clg_tests.hpp"
+#include <fstream>
+
+namespace {
+    class BytecodeCache: public ::testing::Test {
+    protected:
+        std::filesystem::path mDirectory;
+
+        void SetUp() override {
+            mDirectory = std::filesystem::temp_directory_path() /
+                         ("clg_tests_" + std::string(::testing::UnitTest::GetInstance()->current_test_info()->name()));
+            std::filesystem::remove_all(mDirectory);
+            std::filesystem::create_directories(mDirectory);
+        }
+
+        void TearDown() override {
+            std::filesystem::remove_all(mDirectory);
+        }
+
+        std::string write_script(const std::string& name, const std::string& code) {
+            auto path = mDirectory / name;
+            std::ofstream(path) << code;
+            return path.string();
+        }
+
+        std::size_t compiled_files() const {
+            std::size_t count = 0;
+            for (const auto& file : std::filesystem::directory_iterator(mDirectory / "luac")) {
+                count += file.path().extension() == ".luac";
+            }
+            return count;
+        }
+    };
+}
+
+TEST_F(BytecodeCache, DoFileLoadsCompiledChunkInAnotherState) {
+    auto script = write_script("script.lua", "#!/usr/bin/env lua\nreturn debug.getinfo(1, 'l').currentline");
+    {
+        clg::vm vm;
+        vm.set_bytecode_cache(std::make_shared<clg::bytecode_cache>(mDirectory / "luac"));
+        EXPECT_EQ(vm.do_file<int>(script), 2);
+    }
+    EXPECT_EQ(compiled_files(), 1u);
+
+    clg::vm vm;
+    auto cache = std::make_shared<clg::bytecode_cache>(mDirectory / "luac");
+    vm.set_bytecode_cache(cache);
+    EXPECT_EQ(vm.do_file<int>(script), 2);
+    EXPECT_EQ(cache->memory_entries(), 1u);
+}
+
+TEST_F(BytecodeCache, StaleChunkIsCompiledAgain) {
+    auto script = write_script("script.lua", "return 1");
+    auto cache = std::make_shared<clg::bytecode_cache>(mDirectory / "luac");
+    {
+        clg::vm vm;
+        vm.set_bytecode_cache(cache);
+        EXPECT_EQ(vm.do_file<int>(script), 1);
+    }
+    cache->clear_memory();
+    for (const auto& file : std::filesystem::directory_iterator(mDirectory / "luac")) {
+        std::ofstream(file.path(), std::ios::binary | std::ios::trunc) << "\x1bgarbage";
+    }
+    clg::vm vm;
+    vm.set_bytecode_cache(cache);
+    EXPECT_EQ(vm.do_file<int>(script), 1);
+}
+
+TEST_F(BytecodeCache, CorruptedChunkIsCompiledAgain) {
+    auto script = write_script("script.lua", "local t = {} for i = 1, 10 do t[i] = i * i end return t[10]");
+    auto cache = std::make_shared<clg::bytecode_cache>(mDirectory / "luac");
+    {
+        clg::vm vm;
+        vm.set_bytecode_cache(cache);
+        EXPECT_EQ(vm.do_file<int>(script), 100);
+    }
+    ASSERT_EQ(compiled_files(), 1u);
+    auto file = std::filesystem::directory_iterator(mDirectory / "luac")->path();
+    auto size = std::filesystem::file_size(file);
+    std::filesystem::resize_file(file, size - 8);
+
+    cache->clear_memory();
+    clg::vm vm;
+    vm.set_bytecode_cache(cache);
+    EXPECT_EQ(vm.do_file<int>(script), 100);
+    EXPECT_EQ(std::filesystem::file_size(file), size);
+}
+
+TEST_F(BytecodeCache, ChunkOfAnotherSourceIsNotLoaded) {
+    auto cache = std::make_shared<clg::bytecode_cache>(mDirectory / "luac");
+    {
+        clg::vm vm;
+        vm.set_bytecode_cache(cache, true);
+        EXPECT_EQ(vm.do_string<int>("return 1"), 1);
+    }
+    ASSERT_EQ(compiled_files(), 1u);
+
+    // pretend "return 2" collides with "return 1"
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.luac",
+                  static_cast<unsigned long long>(clg::bytecode_cache::hash("return 2", "return 2")));
+    std::filesystem::copy_file(std::filesystem::directory_iterator(mDirectory / "luac")->path(), mDirectory / "luac" / name);
+
+    cache->clear_memory();
+    clg::vm vm;
+    vm.set_bytecode_cache(cache, true);
+    EXPECT_EQ(vm.do_string<int>("return 2"), 2);
+    EXPECT_EQ(vm.do_string<int>("return 1"), 1);
+}
+
+TEST_F(BytecodeCache, DoStringIsNotCachedByDefault) {
+    clg::vm vm;
+    auto cache = std::make_shared<clg::bytecode_cache>(mDirectory / "luac");
+    vm.set_bytecode_cache(cache);
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(vm.do_string<int>("return " + std::to_string(i)), i);
+    }
+    EXPECT_EQ(cache->memory_entries(), 0u);
+    EXPECT_EQ(compiled_files(), 0u);
+
+    vm.set_bytecode_cache(cache, true);
+    EXPECT_EQ(vm.do_string<int>("return 1"), 1);
+    EXPECT_EQ(vm.do_string<int>("return 1"), 1);
+    EXPECT_EQ(cache->memory_entries(), 1u);
+}
+
+TEST_F(BytecodeCache, EvictsLeastRecentlyUsedChunks) {
+    clg::vm vm;
+    auto cache = std::make_shared<clg::bytecode_cache>(2);
+    vm.set_bytecode_cache(cache, true);
+    vm.do_string("return 1");
+    vm.do_string("return 2");
+    vm.do_string("return 1");
+    vm.do_string("return 3");
+    EXPECT_EQ(cache->memory_entries(), 2u);
+    EXPECT_EQ(vm.do_string<int>("return 2"), 2);
+    EXPECT_EQ(cache->memory_entries(), 2u);
+}
@@ -0,0 +1,184 @@
+#include "clg_tests.hpp"
+
+namespace {
+    int add_noexcept(int a, int b) noexcept {
+        return a + b;
+    }
+
+    std::size_t string_length_noexcept(const std::string& s) noexcept {
+        return s.size();
+    }
+}
+
+TEST(CFunction, NothrowBindingCleansTempTable) {
+    clg::vm vm;
+    vm.register_function<add_noexcept>("add_noexcept");
+    const int before = clg_tests::cleanTempTableCalls;
+    EXPECT_EQ(vm.do_string<int>("return add_noexcept(1, 2)"), 3);
+    EXPECT_EQ(clg_tests::cleanTempTableCalls, before + 1);
+}
+
+TEST(CFunction, NothrowBindingRaisesConversionErrors) {
+    clg::vm vm;
+    vm.register_function<add_noexcept>("add_noexcept");
+    EXPECT_EQ(vm.do_string<std::string>("local ok, e = pcall(add_noexcept, 1, {}) return e"),
+              "bad argument #2 to 'add_noexcept' (not a number)");
+}
+
+TEST(CFunction, StringArgumentsAreNotConvertedWithoutExceptionHandling) {
+    clg::vm vm;
+    vm.register_function<string_length_noexcept>("string_length_noexcept");
+    EXPECT_EQ(vm.do_string<int>("return string_length_noexcept('abc')"), 3);
+    // checked bindings return (nil, message) while nothrow ones raise
+    EXPECT_TRUE(vm.do_string<bool>("local r, e = string_length_noexcept({}) return r == nil and e ~= nil"));
+}
+
+namespace {
+    int add(int a, int b) {
+        return a + b;
+    }
+
+    std::string describe(std::string_view name, bool flag, double value) {
+        return std::string(name) + (flag ? ":on:" : ":off:") + std::to_string(int(value));
+    }
+
+    int checked_divide(int a, int b) {
+        if (b == 0) {
+            throw std::invalid_argument("division by zero");
+        }
+        return a / b;
+    }
+
+    void register_overloaded(clg::vm& vm) {
+        vm.register_function_overloaded("overloaded",
+                                        [](int a) { return a; },
+                                        [](int a, int b) { return a + b; },
+                                        [](const std::string& s) { return int(s.size()) * 100; });
+    }
+}
+
+TEST(CFunction, OverloadsDispatchOnCountAndTypes) {
+    clg::vm vm;
+    register_overloaded(vm);
+    EXPECT_EQ(vm.do_string<int>("return overloaded(7)"), 7);
+    EXPECT_EQ(vm.do_string<int>("return overloaded(1, 2)"), 3);
+    EXPECT_EQ(vm.do_string<int>("return overloaded('abcd')"), 400);
+}
+
+TEST(CFunction, OverloadsFallThroughFailedConversions) {
+    clg::vm vm;
+    register_overloaded(vm);
+    EXPECT_EQ(vm.do_string<int>("return overloaded('12')"), 12);
+    EXPECT_EQ(vm.do_string<int>("return overloaded('abc')"), 300);
+}
+
+TEST(CFunction, OverloadsReportArgumentTypes) {
+    clg::vm vm;
+    register_overloaded(vm);
+    auto error = vm.do_string<std::string>("local ok, e = pcall(overloaded, {}, 1) return e");
+    EXPECT_NE(error.find("no overload accepts (table, number)"), std::string::npos) << error;
+    error = vm.do_string<std::string>("local ok, e = pcall(overloaded) return e");
+    EXPECT_NE(error.find("no overload accepts ()"), std::string::npos) << error;
+    error = vm.do_string<std::string>("local ok, e = pcall(overloaded, 1, 2, 3) return e");
+    EXPECT_NE(error.find("no overload accepts (number, number, number)"), std::string::npos) << error;
+}
+
+TEST(CFunction, UncheckedArgumentsDefaultToZeroValues) {
+    clg::vm vm;
+    vm.register_function<add, clg::unchecked>("add_unchecked");
+    vm.register_function<describe, clg::unchecked>("describe_unchecked");
+    EXPECT_EQ(vm.do_string<int>("return add_unchecked(2, 3)"), 5);
+    EXPECT_EQ(vm.do_string<int>("return add_unchecked()"), 0);
+    EXPECT_EQ(vm.do_string<int>("return add_unchecked(4)"), 4);
+    EXPECT_EQ(vm.do_string<int>("return add_unchecked({}, 'x')"), 0);
+    EXPECT_EQ(vm.do_string<std::string>("return describe_unchecked('a', true, 2)"), "a:on:2");
+    EXPECT_EQ(vm.do_string<std::string>("return describe_unchecked()"), ":off:0");
+}
+
+TEST(CFunction, CheckedArgumentsAreValidated) {
+    clg::vm vm;
+    vm.register_function<add>("add");
+    EXPECT_TRUE(vm.do_string<bool>("local r, e = add(1) return r == nil and e ~= nil"));
+    EXPECT_TRUE(vm.do_string<bool>("local r, e = add({}, 1) return r == nil and e ~= nil"));
+}
+
+TEST(CFunction, UncheckedBindingsHandleExceptions) {
+    clg::vm vm;
+    vm.register_function<checked_divide, clg::unchecked>("divide_unchecked");
+    EXPECT_EQ(vm.do_string<int>("return divide_unchecked(6, 3)"), 2);
+    EXPECT_EQ(vm.do_string<std::string>("local r, e = divide_unchecked(1) return e"), "division by zero");
+}
+
+namespace {
+    std::string join(const std::string& a, const std::string& b) {
+        return a + "|" + b;
+    }
+
+    std::string apply(const std::string& prefix, clg::function callback) {
+        return prefix + callback.call<std::string>();
+    }
+
+    std::string copy_after(std::string_view view, clg::function callback) {
+        callback.call<void>();
+        return std::string(view);
+    }
+
+    int fail_with(lua_State* L, const std::string& message) {
+        return luaL_error(L, "%s", message.c_str());
+    }
+
+    void register_strings(clg::vm& vm) {
+        vm.register_function<join>("join");
+        vm.register_function<apply>("apply");
+        vm.register_function<copy_after>("copy_after");
+        vm.register_function<fail_with>("fail_with");
+    }
+}
+
+TEST(CFunction, StringReferenceArguments) {
+    clg::vm vm;
+    register_strings(vm);
+    EXPECT_EQ(vm.do_string<std::string>("return join(string.rep('a', 40), 'b')"), std::string(40, 'a') + "|b");
+    EXPECT_TRUE(vm.do_string<bool>("local r, e = join({}, 'b') return r == nil and e ~= nil"));
+}
+
+TEST(CFunction, NestedStringReferenceArguments) {
+    clg::vm vm;
+    register_strings(vm);
+    EXPECT_EQ(vm.do_string<std::string>(
+            "return apply('outer:', function() return apply('inner:', function() return join('x', 'y') end) end)"),
+              "outer:inner:x|y");
+}
+
+TEST(CFunction, StringArgumentsAfterLuaError) {
+    clg::vm vm;
+    register_strings(vm);
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_EQ(vm.do_string<std::string>("local ok, e = pcall(fail_with, 'boom') return e"), "boom");
+    }
+    EXPECT_EQ(vm.do_string<std::string>("return apply('a', function() pcall(fail_with, 'x') return join('b', 'c') end)"), "ab|c");
+}
+
+TEST(CFunction, StringViewArgumentsSurviveGarbageCollection) {
+    clg::vm vm;
+    register_strings(vm);
+    EXPECT_EQ(vm.do_string<std::string>(
+            "return copy_after(string.rep('v', 64) .. 1, function() collectgarbage() collectgarbage() end)"),
+              std::string(64, 'v') + "1");
+}
+
+TEST(CFunction, CallKeepsValuesBelowOnTheStack) {
+    clg::vm vm;
+    lua_State* L = vm;
+    auto twice = vm.do_string<clg::function>("return function(a) return a * 2 end");
+    auto fail = vm.do_string<clg::function>("return function() error('failure') end");
+
+    lua_settop(L, 0);
+    lua_pushinteger(L, 7);
+    EXPECT_EQ(twice.call<int>(21), 42);
+    twice.call<void>(1);
+    EXPECT_THROW(fail.call<void>(), clg::lua_exception);
+    ASSERT_EQ(lua_gettop(L), 1);
+    EXPECT_EQ(lua_tointeger(L, 1), 7);
+    lua_settop(L, 0);
+}
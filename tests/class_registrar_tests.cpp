@@ -0,0 +1,141 @@
+#include "clg_tests.hpp"
+
+namespace {
+    struct Runner {
+        int value = 42;
+
+        int run(clg::function callback) {
+            callback.call<void>();
+            return value;
+        }
+    };
+}
+
+TEST(ClassRegistrar, MethodSelfOutlivesGarbageCollectionDuringCall) {
+    clg::vm vm;
+    vm.register_class<Runner>().constructor<>().method<&Runner::run>("run");
+    EXPECT_EQ(vm.do_string<int>("return Runner:new():run(function() collectgarbage() collectgarbage() end)"), 42);
+}
+
+namespace {
+    struct Person {
+        std::string name = "anna";
+        std::vector<int> list;
+        int age = 30;
+        const int id = 7;
+
+        int level() const {
+            return mLevel;
+        }
+
+        void setLevel(int level) {
+            if (level < 0) {
+                throw std::invalid_argument("negative level");
+            }
+            mLevel = level;
+        }
+
+        int broken() const {
+            throw std::runtime_error("broken getter");
+        }
+
+    private:
+        int mLevel = 1;
+    };
+
+    clg::vm& person_vm() {
+        static clg::vm vm;
+        static bool registered = [] {
+            vm.register_class<Person>()
+                .constructor<>()
+                .property<&Person::name>("name")
+                .property<&Person::list>("list")
+                .property<&Person::age>("age")
+                .property<&Person::id>("id")
+                .property<&Person::level, &Person::setLevel>("level")
+                .property<&Person::broken>("broken");
+            return true;
+        }();
+        (void) registered;
+        return vm;
+    }
+
+    std::string error_of(const std::string& code) {
+        return person_vm().do_string<std::string>("local ok, e = pcall(function() " + code + " end) return ok and '' or tostring(e)");
+    }
+}
+
+TEST(ClassRegistrar, PropertiesReadAndWrite) {
+    EXPECT_EQ(person_vm().do_string<std::string>(
+            "local p = Person:new() p.name = 'bob' p.list = {1, 2} p.age = 31 p.level = 5 "
+            "return p.name .. #p.list .. p.age .. p.id .. p.level"), "bob23175");
+}
+
+TEST(ClassRegistrar, PropertySetterRaisesOnBadValue) {
+    EXPECT_NE(error_of("Person:new().list = 'oops'").find("failed to set property 'list'"), std::string::npos);
+    EXPECT_NE(error_of("Person:new().name = {}").find("failed to set property 'name'"), std::string::npos);
+    EXPECT_NE(error_of("Person:new().age = {}").find("bad argument #2"), std::string::npos);
+}
+
+TEST(ClassRegistrar, PropertySetterRaisesWhenSetterThrows) {
+    EXPECT_NE(error_of("Person:new().level = -1").find("negative level"), std::string::npos);
+    EXPECT_EQ(person_vm().do_string<int>("local p = Person:new() pcall(function() p.level = -1 end) return p.level"), 1);
+}
+
+TEST(ClassRegistrar, PropertyGetterRaisesWhenGetterThrows) {
+    EXPECT_NE(error_of("return Person:new().broken").find("failed to get property 'broken': broken getter"), std::string::npos);
+}
+
+TEST(ClassRegistrar, ReadOnlyAndUnknownPropertiesAreNotWritable) {
+    EXPECT_NE(error_of("Person:new().id = 1").find("no writable property 'id'"), std::string::npos);
+    EXPECT_NE(error_of("Person:new().unknown = 1").find("no writable property 'unknown'"), std::string::npos);
+}
+
+TEST(ClassRegistrar, PropertyGetterErrorNamesComputedKey) {
+    EXPECT_NE(error_of("local p = Person:new() local k = string.rep('b', 1) .. 'roken' return p[k]")
+                      .find("failed to get property 'broken': broken getter"), std::string::npos);
+}
+
+namespace {
+    struct Scripted: clg::compact_lua_self {
+        std::vector<std::string> handlers;
+
+    protected:
+        void handle_lua_virtual_func_assignment(std::string_view name, clg::ref /* value */) override {
+            if (name == "bad") {
+                throw std::runtime_error("rejected handler");
+            }
+            handlers.emplace_back(name);
+        }
+    };
+}
+
+TEST(ClassRegistrar, VirtualFuncAssignmentErrorsAreRaised) {
+    clg::vm vm;
+    auto scripted = std::make_shared<Scripted>();
+    vm.register_class<Scripted>();
+    vm.register_function("scripted", [scripted] { return scripted; });
+
+    EXPECT_NE(vm.do_string<std::string>(
+            "local s = scripted() s.on_update = function() end "
+            "local ok, e = pcall(function() s.bad = function() end end) return tostring(e)")
+                      .find("failed to assign 'bad': rejected handler"), std::string::npos);
+    EXPECT_EQ(scripted->handlers, std::vector<std::string>{ "on_update" });
+}
+
+namespace {
+    struct Vehicle {
+        virtual ~Vehicle() = default;
+    };
+
+    struct Truck: Vehicle {};
+}
+
+TEST(ClassRegistrar, BaseRegisteredAfterDerivedIsRejected) {
+    clg::vm vm;
+    EXPECT_THROW(vm.register_class<Truck>().bases<Vehicle>(), clg::clg_exception);
+
+    clg::vm ordered;
+    ordered.register_class<Vehicle>();
+    EXPECT_NO_THROW(ordered.register_class<Truck>().bases<Vehicle>());
+}
@@ -0,0 +1,9 @@
+#include "clg_tests.hpp"
+
+namespace clg_tests {
+    int cleanTempTableCalls = 0;
+}
+
+void clean_temp_table(lua_State*) {
+    ++clg_tests::cleanTempTableCalls;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+struct lua_State;
+
+/**
+ * @brief Provided by the tests (clg_tests is built without CLG_MANUAL_CLEANUP); counts the calls.
+ */
+void clean_temp_table(lua_State* s);
+
+namespace clg_tests {
+    extern int cleanTempTableCalls;
+}
+
+#include <gtest/gtest.h>
+#include "clg.hpp"
@@ -0,0 +1,27 @@
+#include "clg_tests.hpp"
+
+TEST(Embedded, DoEmbeddedRunsChunk) {
+    clg::vm vm;
+    EXPECT_EQ(vm.do_embedded<int>("answer"), 42);
+}
+
+TEST(Embedded, ChunksAreNamedByRelativePath) {
+    EXPECT_NE(clg::find_embedded_chunk("lib.greeting"), nullptr);
+    EXPECT_EQ(clg::find_embedded_chunk("greeting"), nullptr);
+}
+
+TEST(Embedded, RequireFindsEmbeddedChunks) {
+    clg::vm vm;
+    vm.enable_embedded_require();
+    EXPECT_EQ(vm.do_string<std::string>("return require('lib.greeting').hello('clg')"), "hello, clg");
+}
+
+TEST(Embedded, MissingChunkThrows) {
+    clg::vm vm;
+    EXPECT_THROW(vm.do_embedded("missing"), clg::lua_exception);
+}
+
+TEST(Embedded, RuntimeErrorsThrow) {
+    clg::vm vm;
+    EXPECT_THROW(vm.do_embedded("failing"), clg::lua_exception);
+}
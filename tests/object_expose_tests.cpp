@@ -0,0 +1,102 @@
+#include "clg_tests.hpp"
+
+namespace {
+    struct Shape: clg::compact_lua_self {
+        int sides() const {
+            return mSides;
+        }
+
+        clg::ref data() const {
+            return luaDataHolder();
+        }
+
+        explicit Shape(int sides): mSides(sides) {}
+
+    private:
+        int mSides;
+    };
+
+    struct Square: Shape {
+        int side = 3;
+
+        Square(): Shape(4) {}
+
+        int area() const {
+            return side * side;
+        }
+    };
+
+    struct CompactObjects: ::testing::Test {
+        clg::vm vm;
+        std::shared_ptr<Square> square = std::make_shared<Square>();
+
+        void SetUp() override {
+            vm.register_class<Shape>().method<&Shape::sides>("sides");
+            vm.register_class<Square>().bases<Shape>().method<&Square::area>("area");
+            vm.register_function("as_shape", [this]() -> std::shared_ptr<Shape> { return square; });
+            vm.register_function("as_square", [this] { return square; });
+            vm.register_function("shapes", [this] { return std::vector<std::shared_ptr<Shape>>{ square }; });
+            vm.register_function("squares", [this] { return std::vector<std::shared_ptr<Square>>{ square }; });
+        }
+    };
+}
+
+TEST_F(CompactObjects, PushedAsDerivedAfterBaseGetsDerivedMethods) {
+    EXPECT_EQ(vm.do_string<int>("local shape = as_shape() shape.tag = 1 "
+                                "local square = as_square() assert(rawequal(shape, square)) "
+                                "return square:area() + square:sides() + square.tag"), 14);
+}
+
+TEST_F(CompactObjects, PushedAsBaseAfterDerivedKeepsDerivedMethods) {
+    EXPECT_EQ(vm.do_string<int>("local square = as_square() local shape = as_shape() "
+                                "assert(rawequal(shape, square)) return shape:area()"), 9);
+}
+
+TEST_F(CompactObjects, ArraysRetypeCachedObjects) {
+    EXPECT_EQ(vm.do_string<int>("local shape = shapes()[1] assert(shape.area == nil) "
+                                "local square = squares()[1] assert(rawequal(shape, square)) return square:area()"), 9);
+}
+
+TEST_F(CompactObjects, FieldsLiveAsLongAsLuaObject) {
+    vm.do_string("keep = as_square() keep.name = 'sq'");
+    EXPECT_FALSE(square->data().isNull());
+    EXPECT_EQ(vm.do_string<std::string>("collectgarbage() collectgarbage() return as_shape().name"), "sq");
+
+    vm.do_string("keep = nil collectgarbage() collectgarbage()");
+    EXPECT_TRUE(square->data().isNull());
+    EXPECT_TRUE(vm.do_string<bool>("return as_square().name == nil"));
+}
+
+TEST_F(CompactObjects, DestroyDetachesFields) {
+    EXPECT_TRUE(vm.do_string<bool>("local a = as_square() a.name = 'sq' a:destroy() "
+                                   "local b = as_square() return not rawequal(a, b) and b.name == nil and b:area() == 9"));
+    EXPECT_EQ(square.use_count(), 2);
+}
+
+namespace {
+    struct Polygon: clg::compact_lua_self {
+        int corners() const {
+            return 6;
+        }
+    };
+
+    struct Hexagon: Polygon {
+        int side = 2;
+
+        int perimeter() const {
+            return side * corners();
+        }
+    };
+}
+
+TEST(CompactObjectsWithoutBases, PushedAsBaseAfterDerivedKeepsDerivedMethods) {
+    clg::vm vm;
+    auto hexagon = std::make_shared<Hexagon>();
+    vm.register_class<Polygon>().method<&Polygon::corners>("corners");
+    vm.register_class<Hexagon>().method<&Hexagon::perimeter>("perimeter");
+    vm.register_function("as_polygon", [hexagon]() -> std::shared_ptr<Polygon> { return hexagon; });
+    vm.register_function("as_hexagon", [hexagon] { return hexagon; });
+
+    EXPECT_EQ(vm.do_string<int>("local hexagon = as_hexagon() local polygon = as_polygon() "
+                                "assert(rawequal(hexagon, polygon)) return polygon:perimeter()"), 12);
+}
@@ -0,0 +1,100 @@
+#include "clg_tests.hpp"
+
+namespace {
+    const clg::profiler::binding_snapshot* find_binding(const std::vector<clg::profiler::binding_snapshot>& bindings,
+                                                         std::string_view name) {
+        for (const auto& binding : bindings) {
+            if (binding.name == name) {
+                return &binding;
+            }
+        }
+        return nullptr;
+    }
+}
+
+TEST(Profiler, CountsCallsOfLuaFunctions) {
+    clg::vm vm;
+    auto f = vm.do_string<clg::function>("return function(a) return a * 2 end");
+    auto copy = f;
+
+    clg::profiler::reset();
+    clg::profiler::set_enabled(true);
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_EQ(f.call<int>(i), i * 2);
+    }
+    EXPECT_EQ(copy.call<int>(5), 10);
+    clg::profiler::set_enabled(false);
+    f.call<int>(1);
+
+    auto bindings = clg::profiler::snapshot();
+    auto binding = find_binding(bindings, "[string \"return function(a) return a * 2 end\"]:1");
+    ASSERT_NE(binding, nullptr);
+    EXPECT_EQ(binding->direction, clg::profiler::direction::cpp_to_lua);
+    EXPECT_EQ(binding->calls, 4u);
+}
+
+namespace {
+    int profiled_square(int x) {
+        return x * x;
+    }
+}
+
+TEST(Profiler, CountsCallsOfBindings) {
+    clg::vm vm;
+    vm.register_function<profiled_square>("profiled_square");
+
+    clg::profiler::reset();
+    clg::profiler::set_enabled(true);
+    EXPECT_EQ(vm.do_string<int>("local s = 0 for i = 1, 5 do s = s + profiled_square(i) end return s"), 55);
+    clg::profiler::set_enabled(false);
+    vm.do_string<int>("return profiled_square(2)");
+
+    auto bindings = clg::profiler::snapshot();
+    auto binding = find_binding(bindings, "profiled_square");
+    ASSERT_NE(binding, nullptr);
+    EXPECT_EQ(binding->direction, clg::profiler::direction::lua_to_cpp);
+    EXPECT_EQ(binding->calls, 5u);
+    std::uint64_t histogramCalls = 0;
+    for (auto bucket : binding->histogram) {
+        histogramCalls += bucket;
+    }
+    EXPECT_EQ(histogramCalls, 5u);
+}
+
+TEST(Profiler, HistogramBucketsArePowersOfTwo) {
+    clg::profiler::binding_stats stats("histogram", clg::profiler::direction::lua_to_cpp);
+    stats.record(0);
+    stats.record(1);
+    stats.record(2);
+    stats.record(3);
+    stats.record(4);
+    stats.record(1024);
+    stats.record(2047);
+    stats.record(std::uint64_t(1) << 40);
+
+    EXPECT_EQ(stats.histogram[0], 2u);
+    EXPECT_EQ(stats.histogram[1], 2u);
+    EXPECT_EQ(stats.histogram[2], 1u);
+    EXPECT_EQ(stats.histogram[10], 2u);
+    EXPECT_EQ(stats.histogram[clg::profiler::histogram_buckets - 1], 1u);
+    EXPECT_EQ(stats.calls, 8u);
+
+    stats.reset();
+    EXPECT_EQ(stats.calls, 0u);
+    EXPECT_EQ(stats.totalNs, 0u);
+    for (const auto& bucket : stats.histogram) {
+        EXPECT_EQ(bucket, 0u);
+    }
+}
+
+TEST(Profiler, ResetDropsBindingsFromSnapshot) {
+    clg::vm vm;
+    vm.register_function<profiled_square>("profiled_square");
+    clg::profiler::set_enabled(true);
+    vm.do_string<int>("return profiled_square(3)");
+    clg::profiler::set_enabled(false);
+    ASSERT_NE(find_binding(clg::profiler::snapshot(), "profiled_square"), nullptr);
+
+    clg::profiler::reset();
+    EXPECT_EQ(find_binding(clg::profiler::snapshot(), "profiled_square"), nullptr);
+}
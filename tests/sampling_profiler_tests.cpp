@@ -0,0 +1,74 @@
+#include "clg_tests.hpp"
+
+namespace {
+    int sum_with(clg::function f, int n) {
+        return f.call<int>(n);
+    }
+
+    constexpr auto SAMPLED_SCRIPT = R"(-- sampled
+local function work(n)
+    local s = 0
+    for i = 1, n do s = s + i end
+    return s
+end
+local total = 0
+for i = 1, 200 do total = total + sum_with(work, 1000) end
+return total
+)";
+}
+
+TEST(SamplingProfiler, FoldsStacksThroughBindings) {
+    clg::vm vm;
+    vm.register_function<sum_with>("sum_with");
+
+    vm.start_sampling(100);
+    EXPECT_EQ(vm.do_string<int>(SAMPLED_SCRIPT), 200 * 500500);
+    vm.stop_sampling();
+
+    const std::string main = "main [string \"-- sampled...\"]";
+    const std::string expected = main + ";sum_with;? [string \"-- sampled...\"]:2 ";
+    auto folded = vm.sampled_stacks_folded();
+    auto line = folded.find(expected);
+    ASSERT_NE(line, std::string::npos) << folded;
+    EXPECT_TRUE(line == 0 || folded[line - 1] == '\n') << folded;
+    EXPECT_GT(std::stoul(folded.substr(line + expected.size())), 100u) << folded;
+
+    for (std::size_t begin = 0; begin < folded.size();) {
+        auto end = folded.find('\n', begin);
+        ASSERT_NE(end, std::string::npos);
+        EXPECT_EQ(folded.compare(begin, main.size(), main), 0) << folded.substr(begin, end - begin);
+        begin = end + 1;
+    }
+}
+
+TEST(SamplingProfiler, SamplesCoroutinesCreatedWhileRunning) {
+    clg::vm vm;
+    vm.start_sampling(10);
+    vm.do_string<void>(R"(-- coroutine
+local co = coroutine.wrap(function()
+    local s = 0
+    for i = 1, 10000 do s = s + i end
+end)
+co()
+)");
+    vm.stop_sampling();
+
+    auto folded = vm.sampled_stacks_folded();
+    EXPECT_NE(folded.find("? [string \"-- coroutine...\"]:2 "), std::string::npos) << folded;
+}
+
+TEST(SamplingProfiler, StopAndReset) {
+    clg::vm vm;
+    vm.register_function<sum_with>("sum_with");
+    vm.start_sampling(100);
+    vm.do_string<int>(SAMPLED_SCRIPT);
+    vm.stop_sampling();
+    auto folded = vm.sampled_stacks_folded();
+    EXPECT_FALSE(folded.empty());
+
+    vm.do_string<int>(SAMPLED_SCRIPT);
+    EXPECT_EQ(vm.sampled_stacks_folded(), folded);
+
+    vm.reset_sampling();
+    EXPECT_TRUE(vm.sampled_stacks_folded().empty());
+}
@@ -0,0 +1 @@
+return 42
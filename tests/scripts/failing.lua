@@ -0,0 +1 @@
+error("embedded failure")
@@ -0,0 +1,61 @@
+#include "clg_tests.hpp"
+#include "vm_pool.hpp"
+#include <thread>
+
+namespace {
+    void init_vm(clg::vm& vm) {
+        vm.do_string("answer = 42 config = { mode = 'fast' } package.loaded.common = { version = 1 }");
+    }
+}
+
+TEST(VmPool, RestoresGlobalsOnReturn) {
+    clg::vm_pool pool(1, init_vm);
+    {
+        auto vm = pool.checkout();
+        EXPECT_EQ(pool.available(), 0u);
+        vm->do_string("added = true answer = 0 config = nil print = nil");
+    }
+    EXPECT_EQ(pool.available(), 1u);
+
+    auto vm = pool.checkout();
+    EXPECT_TRUE(vm->do_string<bool>("return added == nil and answer == 42 and config.mode == 'fast' and print ~= nil"));
+}
+
+TEST(VmPool, RestoresLoadedModulesOnReturn) {
+    clg::vm_pool pool(1, init_vm);
+    {
+        auto vm = pool.checkout();
+        vm->do_string("package.loaded.scratch = {} package.loaded.common = { version = 2 }");
+    }
+    auto vm = pool.checkout();
+    EXPECT_TRUE(vm->do_string<bool>("return package.loaded.scratch == nil and require('common').version == 1"));
+}
+
+TEST(VmPool, RestoreIsShallow) {
+    clg::vm_pool pool(1, init_vm);
+    {
+        auto vm = pool.checkout();
+        vm->do_string("config.mode = 'slow'");
+    }
+    auto vm = pool.checkout();
+    EXPECT_EQ(vm->do_string<std::string>("return config.mode"), "slow");
+}
+
+TEST(VmPool, ChecksOutOnWorkerThreads) {
+    clg::vm_pool pool(2, init_vm);
+    std::vector<int> results(4);
+    std::vector<std::thread> workers;
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        workers.emplace_back([&, i] {
+            auto vm = pool.checkout();
+            results[i] = vm->do_string<int>("leaked = (leaked or 0) + 1 return answer + leaked");
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    for (int result : results) {
+        EXPECT_EQ(result, 43);
+    }
+    EXPECT_EQ(pool.available(), 2u);
+}
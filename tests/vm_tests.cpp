@@ -0,0 +1,118 @@
+#include "clg_tests.hpp"
+#include <thread>
+
+TEST(Vm, DestructionKeepsCallbacks) {
+    int errors = 0;
+    clg::function::error_callback() = [&] { ++errors; };
+    {
+        clg::vm other;
+    }
+    EXPECT_TRUE(bool(clg::function::error_callback()));
+    {
+        clg::vm vm;
+        auto f = vm.do_string<clg::function>("return function() error('failure') end");
+        EXPECT_THROW(f.call<void>(), clg::lua_exception);
+    }
+    EXPECT_EQ(errors, 1);
+    clg::function::error_callback() = {};
+}
+
+TEST(Vm, StatesOnDifferentThreads) {
+    std::vector<int> results(4);
+    std::vector<std::thread> workers;
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        workers.emplace_back([&, i] {
+            clg::vm vm;
+            auto table = vm.do_string<clg::ref>("return { value = " + std::to_string(i) + " }");
+            results[i] = table.as<clg::table_view>()["value"].as<int>();
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        EXPECT_EQ(results[i], int(i));
+    }
+}
+
+#ifndef NDEBUG
+TEST(VmDeathTest, RefOfAnotherStateIsCaught) {
+    EXPECT_DEATH({
+        clg::vm a;
+        auto value = a.do_string<clg::ref>("return {}");
+        clg::vm b;
+        value.push_value_to_stack();
+    }, "does not belong");
+}
+
+TEST(VmDeathTest, StateOwnedByAnotherThreadIsCaught) {
+    EXPECT_DEATH({
+        clg::vm vm;
+        std::thread([&] {
+            clg::impl::raii_state_updater bind(static_cast<lua_State*>(vm));
+            clg::check_thread();
+        }).join();
+    }, "");
+}
+#endif
+
+namespace {
+    struct ChunkCache: ::testing::Test {
+        clg::vm vm;
+        clg::function countCompiled;
+
+        void SetUp() override {
+            // the cache is the only strong reference to the compiled snippets
+            vm.do_string("compiled = setmetatable({}, { __mode = 'v' })");
+            countCompiled = vm.compile("collectgarbage() collectgarbage() local n = 0 for _ in pairs(compiled) do n = n + 1 end return n");
+        }
+
+        /**
+         * @return whether the snippet tagged name reused the function compiled by its previous run.
+         */
+        bool run(const std::string& name) {
+            vm.do_string("local f = debug.getinfo(1, 'f').func reused = rawequal(compiled." + name + ", f) compiled." + name + " = f");
+            return vm.global_variable("reused").as<bool>();
+        }
+
+        int compiled_alive() {
+            return vm.do_string<int>(countCompiled);
+        }
+    };
+}
+
+TEST_F(ChunkCache, EvictsLeastRecentlyUsedSnippet) {
+    vm.set_chunk_cache_capacity(2);
+    EXPECT_FALSE(run("a"));
+    EXPECT_FALSE(run("b"));
+    EXPECT_TRUE(run("a"));
+    EXPECT_FALSE(run("c")); // evicts b
+    EXPECT_TRUE(run("a"));
+    EXPECT_TRUE(run("c"));
+    EXPECT_FALSE(run("b")); // evicts a
+    EXPECT_FALSE(run("a"));
+}
+
+TEST_F(ChunkCache, ZeroCapacityDisablesCache) {
+    EXPECT_EQ(vm.chunk_cache_capacity(), 0u);
+    EXPECT_FALSE(run("a"));
+    EXPECT_FALSE(run("a"));
+    EXPECT_EQ(compiled_alive(), 0);
+}
+
+TEST_F(ChunkCache, EvictionReleasesCompiledSnippets) {
+    vm.set_chunk_cache_capacity(3);
+    run("a");
+    run("b");
+    run("c");
+    EXPECT_EQ(compiled_alive(), 3);
+    run("d");
+    EXPECT_EQ(compiled_alive(), 3);
+
+    vm.set_chunk_cache_capacity(1);
+    EXPECT_EQ(compiled_alive(), 1);
+    EXPECT_TRUE(run("d"));
+
+    vm.set_chunk_cache_capacity(0);
+    EXPECT_EQ(compiled_alive(), 0);
+}